@@ -21,10 +21,11 @@ solution("iox")
             "boost_filesystem",
             "boost_coroutine",
             "jsoncpp",
-            "readline"
+            "readline",
+            "dl"
         }
         files {
-            "src/**.cpp",
+            "src/main.cpp",
             "src/**.h"
         }
 
@@ -58,3 +59,24 @@ solution("iox")
                 linkoptions { "-stdlib=libc++" }
         configuration {}
 
+    -- interpreter for embedding, see src/iox.h
+    project("libiox")
+        kind("StaticLib")
+        language("C++")
+        targetname("iox")
+        files {
+            "src/iox.cpp",
+            "src/**.h"
+        }
+
+        includedirs {
+            "../vendor/include/"
+        }
+
+        configuration { "gmake" }
+            buildoptions { "-std=c++11" }
+            configuration { "macosx" }
+                buildoptions { "-U__STRICT_ANSI__", "-stdlib=libc++" }
+                linkoptions { "-stdlib=libc++" }
+        configuration {}
+
@@ -0,0 +1,4448 @@
+#ifndef _CONTEXT_H
+#define _CONTEXT_H
+
+#include <iostream>
+#include <stack>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <random>
+#include <limits>
+#include <chrono>
+#include <boost/scope_exit.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <spawn.h>
+#include <signal.h>
+using namespace std;
+
+#include <boost/any.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/tokenizer.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/regex.hpp>
+#include <boost/multiprecision/cpp_int.hpp>
+#include <json/json.h>
+#include "kit/async/async.h"
+#include "kit/kit.h"
+#include "native.h"
+
+using boost::lexical_cast;
+
+// Int values that overflow int64_t are promoted to this
+typedef boost::multiprecision::cpp_int big_int;
+
+static const size_t PATTERN_CACHE = 256;
+static const size_t PAR_CHUNK = 1 << 14;
+
+struct Variable
+{
+    enum ID {
+        Int = 0,
+        String,
+        Real,
+        Bool,
+        List,
+        IO,
+        BigInt // an Int too large for int64_t
+    };
+    enum Wrapper {
+        PRIMITIVE = 0,
+        ADDRESS = kit::bit(0),
+        REACTIVE = kit::bit(1)
+    };
+    
+    //Variable(){
+    //}
+    Variable(boost::any v, ID t):
+        val(v),
+        type(t),
+        wrapper(0)
+    {}
+
+    Variable(Variable&&) = default;
+    Variable& operator=(Variable&&) = default;
+    Variable(const Variable&) = default;
+    Variable& operator=(const Variable&) = default;
+
+    ID type;
+    unsigned wrapper;
+    
+    std::string name; // reflection!
+    boost::any val;
+};
+
+// names of Variable::ID, a function so including this in several
+// translation units defines it once
+inline const vector<string>& type_names()
+{
+    static const vector<string> r {
+        "int",
+        "str",
+        "real",
+        "bool",
+        "list",
+        "io",
+        "int"
+    };
+    return r;
+}
+
+struct UserFunction;
+
+// a token, with its function resolution cached after the first call
+struct Token
+{
+    Token(std::string s):
+        text(move(s))
+    {}
+    
+    std::string text;
+    // values of a pure builtin called on literals, computed at compile time
+    std::shared_ptr<const vector<Variable>> folded;
+    function<void()>* builtin = nullptr;
+    UserFunction* user = nullptr;
+    unsigned long long* calls = nullptr;
+};
+
+// one source line, split into tokens
+struct Line
+{
+    // trailing loop keyword, the indented block is the body
+    enum Loop {
+        None = 0,
+        Each,
+        While
+    };
+    
+    unsigned ln = 0;
+    int indent = 0;
+    bool quiet = false; // ends in ';'
+    bool otherwise = false; // starts with "else"
+    size_t end = 0; // index past this line's indented block
+    Loop loop = None;
+    vector<Token> tokens;
+};
+
+struct Mark
+{
+    const vector<Line>* block;
+    size_t pc;
+};
+
+struct UserFunction
+{
+    std::string name;
+    vector<Line> body;
+};
+
+// split a source line into tokens
+// returns false for blank lines and comments
+inline bool tokenize(const std::string& src, unsigned ln, Line& line)
+{
+    auto ind = src.find_first_not_of(" \t");
+    if(ind == std::string::npos || src[ind] == '#')
+        return false;
+    
+    line.ln = ln;
+    line.indent = ind;
+    line.quiet = false;
+    line.tokens.clear();
+    
+    unsigned s;
+    unsigned e = ind;
+    bool eol = false;
+    while(not eol)
+    {
+        s = e;
+        
+        // find [s,e) of token
+        bool in_quote = false;
+        while(true){
+            if(e >= src.size()){
+                if(in_quote)
+                    throw std::runtime_error((boost::format(
+                        "quote parse issue @ %s\n    %s"
+                        ) % ln % src
+                    ).str());
+                eol = true;
+                break;
+            }
+            char c = src[e++];
+            if(c=='\"' || c=='\'')
+                in_quote = !in_quote;
+            else if(!in_quote)
+                if(c==' ' || c==',')
+                    break;
+        }
+        
+        string token = src.substr(s,e-s);
+        boost::trim(token);
+        if(not token.empty())
+            line.tokens.emplace_back(move(token));
+    }
+    
+    // trailing ';' blocks the line's result from being returned
+    if(not line.tokens.empty())
+    {
+        string& t = line.tokens.back().text;
+        if(t[0] != '\'' && t[0] != '\"' && boost::ends_with(t, ";"))
+        {
+            line.quiet = true;
+            t.pop_back();
+            if(t.empty())
+                line.tokens.pop_back();
+        }
+    }
+    return not line.tokens.empty();
+}
+
+// name of a function declared by this line ("name:"), or empty
+inline std::string declaration(const Line& line)
+{
+    const string& t = line.tokens.at(0).text;
+    if(t.size() < 2 || t.back() != ':' || t[0] == '\'' || t[0] == '\"')
+        return std::string();
+    return t.substr(0, t.size() - 1);
+}
+
+// precompute the end of each line's indented block,
+// which is where a failed ? or a finished branch jumps to
+inline void link(vector<Line>& lines)
+{
+    vector<size_t> open;
+    size_t sz = lines.size();
+    for(size_t i=0; i < sz; ++i)
+    {
+        lines[i].otherwise = lines[i].tokens[0].text == "else";
+        const string& last = lines[i].tokens.back().text;
+        if(last == "each")
+            lines[i].loop = Line::Each;
+        else if(last == "while")
+            lines[i].loop = Line::While;
+        while(not open.empty() && lines[open.back()].indent >= lines[i].indent)
+        {
+            lines[open.back()].end = i;
+            open.pop_back();
+        }
+        open.push_back(i);
+    }
+    for(size_t i: open)
+        lines[i].end = sz;
+}
+
+// always-on runtime counters, reported by "stats" and --stats
+struct Stats
+{
+    unsigned long long tokens = 0;
+    unsigned long long allocs = 0;
+    unsigned long long jumps = 0;
+    unsigned long long spills = 0;
+    unsigned long long spilled_bytes = 0;
+    unsigned long long reloads = 0;
+    size_t peak_depth = 0;
+    std::chrono::steady_clock::duration blocked =
+        std::chrono::steady_clock::duration::zero();
+    unordered_map<string, unsigned long long> calls;
+};
+
+// --trace: timed events kept per thread in a fixed ring, oldest dropped
+// written out as Chrome trace JSON, for chrome://tracing or Perfetto
+struct Trace
+{
+    typedef std::chrono::steady_clock clock;
+    
+    struct Event
+    {
+        clock::time_point start;
+        clock::duration dur;
+        unsigned arg; // line number of line events
+        char cat;
+        char name[19];
+    };
+    
+    // only its owning thread writes, so recording takes no lock
+    // rings of finished threads are handed to the next thread started
+    struct Ring
+    {
+        unsigned tid = 0;
+        uint64_t n = 0;
+        vector<Event> events;
+        std::atomic<bool> free{false};
+    };
+    
+    static const size_t RING = 1 << 16;
+    
+    static bool& on()
+    {
+        static bool r = false;
+        return r;
+    }
+    
+    static std::mutex& mtx()
+    {
+        static std::mutex r;
+        return r;
+    }
+    
+    static vector<std::unique_ptr<Ring>>& rings()
+    {
+        static vector<std::unique_ptr<Ring>> r;
+        return r;
+    }
+    
+    static Ring& ring()
+    {
+        struct Owner
+        {
+            Ring* r = nullptr;
+            ~Owner() { if(r) r->free = true; }
+        };
+        thread_local Owner owner;
+        if(owner.r)
+            return *owner.r;
+        std::lock_guard<std::mutex> lock(mtx());
+        for(auto&& r: rings())
+            if(r->free.exchange(false))
+                return *(owner.r = r.get());
+        rings().emplace_back(new Ring);
+        owner.r = rings().back().get();
+        owner.r->tid = rings().size();
+        owner.r->events.resize(RING);
+        return *owner.r;
+    }
+    
+    static void record(char cat, const char* name, unsigned arg,
+        clock::time_point start)
+    {
+        Ring& r = ring();
+        Event& e = r.events[r.n++ % RING];
+        e.start = start;
+        e.dur = clock::now() - start;
+        e.arg = arg;
+        e.cat = cat;
+        strncpy(e.name, name, sizeof(e.name) - 1);
+        e.name[sizeof(e.name) - 1] = '\0';
+    }
+    
+    // call after every traced thread has finished
+    static void dump(std::ostream& out)
+    {
+        static const char* const cats[] = {
+            "builtin", "call", "io", "line", "parallel"
+        };
+        auto epoch = clock::time_point::max();
+        for(auto&& r: rings())
+            for(uint64_t i = r->n > RING ? r->n - RING : 0; i < r->n; ++i)
+                epoch = std::min(epoch, r->events[i % RING].start);
+        
+        auto us = [](clock::duration d){
+            return std::chrono::duration<double, std::micro>(d).count();
+        };
+        Json::Value events(Json::arrayValue);
+        for(auto&& r: rings())
+        {
+            for(uint64_t i = r->n > RING ? r->n - RING : 0; i < r->n; ++i)
+            {
+                const Event& e = r->events[i % RING];
+                Json::Value j;
+                j["ph"] = "X";
+                j["pid"] = (Json::UInt)getpid();
+                j["tid"] = r->tid;
+                j["ts"] = us(e.start - epoch);
+                j["dur"] = us(e.dur);
+                j["cat"] = cats[string("bcilp").find(e.cat)];
+                if(e.cat == 'l')
+                {
+                    j["name"] = "line " + lexical_cast<string>(e.arg + 1);
+                    j["args"]["line"] = e.arg + 1;
+                }
+                else
+                    j["name"] = e.name;
+                events.append(j);
+            }
+        }
+        Json::Value root;
+        root["traceEvents"] = events;
+        root["displayTimeUnit"] = "ns";
+        
+        Json::StreamWriterBuilder w;
+        w["indentation"] = "";
+        std::unique_ptr<Json::StreamWriter>(w.newStreamWriter())->write(root, &out);
+        out.flush();
+        if(not out)
+            throw std::runtime_error("unable to write trace");
+    }
+};
+
+// records the time until it goes out of scope, when tracing
+// cat: b builtin, c user call, i I/O wait, l line, p parallel chunk
+struct Traced
+{
+    Traced(char c, const char* n, unsigned a = 0)
+    {
+        if(not Trace::on())
+            return;
+        cat = c;
+        name = n;
+        arg = a;
+        start = Trace::clock::now();
+    }
+    ~Traced()
+    {
+        if(name)
+            Trace::record(cat, name, arg, start);
+    }
+    Traced(const Traced&) = delete;
+    Traced& operator=(const Traced&) = delete;
+    
+    char cat = 0;
+    const char* name = nullptr;
+    unsigned arg = 0;
+    Trace::clock::time_point start;
+};
+
+// values of one type in a single typed buffer, the storage of a list
+struct Column
+{
+    Variable::ID type = Variable::Int;
+    vector<int64_t> ints;
+    vector<double> reals;
+    vector<string> strs;
+    vector<char> bools;
+    
+    size_t bytes() const
+    {
+        size_t sz = sizeof(Column) +
+            ints.capacity() * sizeof(int64_t) +
+            reals.capacity() * sizeof(double) +
+            bools.capacity();
+        for(auto&& s: strs)
+            sz += sizeof(string) + s.capacity();
+        return sz;
+    }
+};
+
+// a list value: a window into a shared column, so slices never copy
+struct Slice
+{
+    std::shared_ptr<const Column> col;
+    size_t offset = 0;
+    size_t size = 0;
+    
+    Variable at(size_t i) const
+    {
+        i += offset;
+        switch(col->type)
+        {
+            case Variable::Int:
+                return Variable(col->ints[i], Variable::Int);
+            case Variable::Real:
+                return Variable(col->reals[i], Variable::Real);
+            case Variable::String:
+                return Variable(col->strs[i], Variable::String);
+            case Variable::Bool:
+                return Variable(bool(col->bools[i]), Variable::Bool);
+            default:
+                assert(false);
+                break;
+        }
+        return Variable(0, Variable::Int);
+    }
+};
+
+// write all of a buffer to a descriptor
+inline void write_all(int fd, const char* p, size_t n)
+{
+    while(n)
+    {
+        ssize_t w = ::write(fd, p, n);
+        if(w < 0 && errno == EINTR)
+            continue;
+        if(w <= 0)
+            throw std::runtime_error("write failed");
+        p += w;
+        n -= w;
+    }
+}
+
+// an open file, mapped into memory on first read
+struct File
+{
+    File(const std::string& fn, int flags):
+        path(fn)
+    {
+        fd = ::open(fn.c_str(), flags | O_CLOEXEC, 0644);
+        if(fd < 0)
+            throw std::runtime_error((boost::format(
+                "unable to open \'%s\'"
+                ) % fn
+            ).str());
+    }
+    
+    // stdout of a shell command, with its stdin fed from feed
+    File(const std::string& cmd, const std::string& feed):
+        path(cmd),
+        input(feed)
+    {
+        int out[2], in[2];
+        if(pipe2(out, O_CLOEXEC) != 0)
+            throw std::runtime_error("unable to create pipe");
+        if(pipe2(in, O_CLOEXEC) != 0)
+        {
+            ::close(out[0]);
+            ::close(out[1]);
+            throw std::runtime_error("unable to create pipe");
+        }
+        
+        posix_spawn_file_actions_t fa;
+        posix_spawn_file_actions_init(&fa);
+        posix_spawn_file_actions_adddup2(&fa, in[0], STDIN_FILENO);
+        posix_spawn_file_actions_adddup2(&fa, out[1], STDOUT_FILENO);
+        const char* argv[] = {"/bin/sh", "-c", cmd.c_str(), nullptr};
+        int r = posix_spawn(&pid, "/bin/sh", &fa, nullptr,
+            const_cast<char* const*>(argv), environ
+        );
+        posix_spawn_file_actions_destroy(&fa);
+        ::close(in[0]);
+        ::close(out[1]);
+        if(r != 0)
+        {
+            // the destructor will not run, so close our ends here
+            ::close(out[0]);
+            ::close(in[1]);
+            pid = 0;
+            throw std::runtime_error("unable to run \'" + cmd + "\'");
+        }
+        fd = out[0];
+        in_fd = in[1];
+        if(input.empty())
+        {
+            ::close(in_fd);
+            in_fd = -1;
+        }
+    }
+    
+    // an unnamed scratch file, gone once closed
+    static std::shared_ptr<File> temp()
+    {
+        const char* dir = getenv("TMPDIR");
+        return std::make_shared<File>(
+            dir && *dir ? dir : "/tmp", O_TMPFILE | O_RDWR
+        );
+    }
+    
+    ~File()
+    {
+        if(data && not pid)
+            munmap(data, size);
+        if(in_fd >= 0)
+            ::close(in_fd);
+        ::close(fd);
+        if(pid && not reaped)
+        {
+            // nobody will read it, so do not wait for it to finish
+            kill(pid, SIGTERM);
+            Traced t('i', "waitpid");
+            while(waitpid(pid, nullptr, 0) < 0 && errno == EINTR);
+        }
+    }
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+    
+    bool process() const { return pid != 0; }
+    
+    // wait for a child whose output is complete and keep its exit status,
+    // 128 + the signal number if it was killed, as shells report it
+    void reap()
+    {
+        int ws = 0;
+        {
+            Traced t('i', "waitpid");
+            while(waitpid(pid, &ws, 0) < 0 && errno == EINTR);
+        }
+        reaped = true;
+        status = WIFSIGNALED(ws) ? 128 + WTERMSIG(ws) : WEXITSTATUS(ws);
+    }
+    
+    // run children until every one has closed its stdout and taken its
+    // input, so that none of them stalls on a full pipe while another is
+    // being read, then reap them all
+    static void drain(const vector<File*>& procs)
+    {
+        int ep = epoll_create1(EPOLL_CLOEXEC);
+        if(ep < 0)
+            throw std::runtime_error("unable to create epoll instance");
+        BOOST_SCOPE_EXIT_ALL(&) {
+            ::close(ep);
+        };
+        
+        // a child that closes its stdin early must not kill us with
+        // SIGPIPE, the write fails with EPIPE instead and input just ends
+        sigset_t pipe_set, old_set;
+        sigemptyset(&pipe_set);
+        sigaddset(&pipe_set, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+        BOOST_SCOPE_EXIT_ALL(&) {
+            // discard a SIGPIPE raised here before unblocking it
+            sigset_t pending;
+            sigpending(&pending);
+            if(not sigismember(&old_set, SIGPIPE) &&
+                sigismember(&pending, SIGPIPE))
+            {
+                timespec zero = {0, 0};
+                sigtimedwait(&pipe_set, nullptr, &zero);
+            }
+            pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+        };
+        
+        // low bit of the event data tells stdin (1) from stdout (0),
+        // open counts both
+        size_t open = 0;
+        for(File* f: procs)
+        {
+            if(f->mapped)
+                continue;
+            epoll_event ev = {};
+            fcntl(f->fd, F_SETFL, O_NONBLOCK);
+            ev.events = EPOLLIN;
+            ev.data.u64 = (uintptr_t)f;
+            // a handle listed twice is registered and counted once
+            if(epoll_ctl(ep, EPOLL_CTL_ADD, f->fd, &ev) != 0)
+                continue;
+            ++open;
+            if(f->in_fd >= 0)
+            {
+                fcntl(f->in_fd, F_SETFL, O_NONBLOCK);
+                ev.events = EPOLLOUT;
+                ev.data.u64 = (uintptr_t)f | 1;
+                if(epoll_ctl(ep, EPOLL_CTL_ADD, f->in_fd, &ev) == 0)
+                    ++open;
+            }
+        }
+        
+        epoll_event evs[16];
+        char chunk[65536];
+        while(open)
+        {
+            int n;
+            {
+                Traced t('i', "epoll_wait");
+                n = epoll_wait(ep, evs, 16, -1);
+            }
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n < 0)
+                throw std::runtime_error("epoll_wait failed");
+            for(int i=0; i < n; ++i)
+            {
+                File* f = (File*)(uintptr_t)(evs[i].data.u64 & ~(uint64_t)1);
+                if(evs[i].data.u64 & 1)
+                {
+                    ssize_t w = ::write(f->in_fd,
+                        f->input.data() + f->input_off,
+                        f->input.size() - f->input_off
+                    );
+                    if(w > 0)
+                        f->input_off += w;
+                    if(w < 0 && errno == EAGAIN)
+                        continue;
+                    if(w < 0 || f->input_off == f->input.size())
+                    {
+                        // done, or the child stopped reading
+                        epoll_ctl(ep, EPOLL_CTL_DEL, f->in_fd, nullptr);
+                        ::close(f->in_fd);
+                        f->in_fd = -1;
+                        --open;
+                    }
+                    continue;
+                }
+                for(;;)
+                {
+                    ssize_t r = ::read(f->fd, chunk, sizeof(chunk));
+                    if(r > 0)
+                    {
+                        f->buf.append(chunk, r);
+                        continue;
+                    }
+                    if(r < 0 && (errno == EAGAIN || errno == EINTR))
+                        break;
+                    epoll_ctl(ep, EPOLL_CTL_DEL, f->fd, nullptr);
+                    f->data = &f->buf[0];
+                    f->size = f->buf.size();
+                    f->mapped = true;
+                    --open;
+                    break;
+                }
+            }
+        }
+        
+        // a child may close its stdout and still be reading stdin,
+        // so none is waited for until all of its input is in
+        for(File* f: procs)
+            if(f->process() && f->mapped && not f->reaped)
+                f->reap();
+    }
+    
+    // map the whole file read-only, pages are loaded as they are touched
+    void map()
+    {
+        if(mapped)
+            return;
+        if(process())
+        {
+            drain(vector<File*>{this});
+            return;
+        }
+        struct stat st;
+        if(fstat(fd, &st) != 0)
+            throw std::runtime_error("unable to stat \'" + path + "\'");
+        size = st.st_size;
+        if(size)
+        {
+            void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(p == MAP_FAILED)
+                throw std::runtime_error("unable to map \'" + path + "\'");
+            madvise(p, size, MADV_SEQUENTIAL);
+            data = (char*)p;
+        }
+        mapped = true;
+    }
+    
+    // copy the whole file to another descriptor without a userspace buffer
+    void send(int out)
+    {
+        if(process())
+        {
+            map();
+            write_all(out, data, size);
+            return;
+        }
+        struct stat st;
+        if(fstat(fd, &st) != 0)
+            throw std::runtime_error("unable to stat \'" + path + "\'");
+        off_t off = 0;
+        while(off < st.st_size)
+        {
+            ssize_t n = sendfile(out, fd, &off, st.st_size - off);
+            if(n > 0)
+                continue;
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n < 0 && errno != EINVAL && errno != ENOSYS)
+                throw std::runtime_error("unable to copy \'" + path + "\'");
+            
+            // descriptor pair not supported by sendfile, write from the map
+            map();
+            while(off < (off_t)size)
+            {
+                ssize_t w = ::write(out, data + off, size - off);
+                if(w < 0 && errno == EINTR)
+                    continue;
+                if(w <= 0)
+                    throw std::runtime_error("unable to copy \'" + path + "\'");
+                off += w;
+            }
+            break;
+        }
+    }
+    
+    std::string path;
+    int fd = -1;
+    char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    
+    // child process state, output is collected into buf instead of mapped
+    pid_t pid = 0;
+    bool reaped = false;
+    int status = 0;
+    int in_fd = -1;
+    std::string input;
+    size_t input_off = 0;
+    std::string buf;
+};
+
+// approximate heap footprint of a value
+inline size_t footprint(const Variable& v)
+{
+    size_t sz = sizeof(Variable) + v.name.capacity();
+    // boost::any keeps its value in a heap block of its own
+    if(not v.val.empty())
+        sz += 32;
+    if(v.type == Variable::String)
+    {
+        const string* s = boost::any_cast<string>(&v.val);
+        if(s)
+            sz += s->capacity();
+    }
+    else if(v.type == Variable::List)
+        sz += boost::any_cast<Slice>(&v.val)->col->bytes();
+    return sz;
+}
+
+// shortest form that reads back as the same double, always marked as real
+inline string real_str(double d)
+{
+    char buf[32];
+    for(int prec = 15; prec <= 17; ++prec)
+    {
+        snprintf(buf, sizeof(buf), "%.*g", prec, d);
+        if(strtod(buf, nullptr) == d)
+            break;
+    }
+    string r = buf;
+    if(r.find_first_of(".eEn") == string::npos)
+        r += ".0";
+    return r;
+}
+
+inline bool is_integer(const Variable& v)
+{
+    return v.type == Variable::Int || v.type == Variable::BigInt;
+}
+
+inline big_int to_big(const Variable& v)
+{
+    if(v.type == Variable::BigInt)
+        return boost::any_cast<big_int>(v.val);
+    return big_int(boost::any_cast<int64_t>(v.val));
+}
+
+// numeric value as a double
+inline double to_real(const Variable& v)
+{
+    switch(v.type)
+    {
+        case Variable::Int:
+            return boost::any_cast<int64_t>(v.val);
+        case Variable::BigInt:
+            return boost::any_cast<big_int>(v.val).convert_to<double>();
+        case Variable::Real:
+            return boost::any_cast<double>(v.val);
+        default:
+            throw std::runtime_error((boost::format(
+                "cannot use %s in arithmetic"
+                ) % type_names()[v.type]
+            ).str());
+    }
+}
+
+// an Int result, kept as int64_t whenever it fits
+inline Variable make_int(const big_int& b)
+{
+    if(b >= std::numeric_limits<int64_t>::min() &&
+        b <= std::numeric_limits<int64_t>::max())
+        return Variable(b.convert_to<int64_t>(), Variable::Int);
+    return Variable(b, Variable::BigInt);
+}
+
+// string representation of a value, as printed by "out"
+inline string to_str(const Variable& v)
+{
+    switch(v.type)
+    {
+        case Variable::String:
+            return boost::any_cast<string>(v.val);
+        case Variable::Int:
+            return lexical_cast<string>(boost::any_cast<int64_t>(v.val));
+        case Variable::BigInt:
+            return boost::any_cast<big_int>(v.val).str();
+        case Variable::Real:
+            return real_str(boost::any_cast<double>(v.val));
+        case Variable::Bool:
+            return boost::any_cast<bool>(v.val) ? "true" : "false";
+        case Variable::IO:
+        {
+            File& f = *boost::any_cast<std::shared_ptr<File>>(v.val);
+            f.map();
+            return string(f.data, f.size);
+        }
+        case Variable::List:
+        {
+            const Slice& l = *boost::any_cast<Slice>(&v.val);
+            string r = "[";
+            for(size_t i=0; i < l.size; ++i)
+            {
+                if(i)
+                    r += ", ";
+                Variable e = l.at(i);
+                if(e.type == Variable::String)
+                    r += "\'" + to_str(e) + "\'";
+                else
+                    r += to_str(e);
+            }
+            return r + "]";
+        }
+        default:
+            assert(false);
+            break;
+    }
+    return string();
+}
+
+// running result of folding a stream with +, - or *
+// ints stay on the int64_t fast path until an operation overflows, then
+// continue as big_int; the first real turns the result real
+struct Accum
+{
+    Accum(char o):
+        op(o),
+        i(o == '*' ? 1 : 0)
+    {}
+    
+    void add(int64_t x)
+    {
+        if(is_real)
+        {
+            add((double)x);
+            return;
+        }
+        if(not is_big)
+        {
+            int64_t y;
+            bool overflow =
+                op == '+' ? __builtin_add_overflow(i, x, &y) :
+                op == '-' ? __builtin_sub_overflow(i, x, &y) :
+                __builtin_mul_overflow(i, x, &y);
+            if(not overflow)
+            {
+                i = y;
+                return;
+            }
+            is_big = true;
+            big = i;
+        }
+        add(big_int(x));
+    }
+    
+    void add(const big_int& x)
+    {
+        if(is_real)
+        {
+            add(x.convert_to<double>());
+            return;
+        }
+        if(not is_big)
+        {
+            is_big = true;
+            big = i;
+        }
+        if(op == '+')
+            big += x;
+        else if(op == '-')
+            big -= x;
+        else
+            big *= x;
+    }
+    
+    void add(double x)
+    {
+        if(not is_real)
+        {
+            is_real = true;
+            r = is_big ? big.convert_to<double>() : (double)i;
+        }
+        if(op == '+')
+            r += x;
+        else if(op == '-')
+            r -= x;
+        else
+            r *= x;
+    }
+    
+    void add(const Variable& v)
+    {
+        switch(v.type)
+        {
+            case Variable::Int:
+                add(boost::any_cast<int64_t>(v.val));
+                break;
+            case Variable::BigInt:
+                add(*boost::any_cast<big_int>(&v.val));
+                break;
+            case Variable::Real:
+                add(boost::any_cast<double>(v.val));
+                break;
+            default:
+                throw std::runtime_error((boost::format(
+                    "cannot use %s in arithmetic"
+                    ) % type_names()[v.type]
+                ).str());
+        }
+    }
+    
+    // combine with the result of another fold of the same op
+    void merge(const Accum& a)
+    {
+        if(a.is_real)
+            add(a.r);
+        else if(a.is_big)
+            add(a.big);
+        else
+            add(a.i);
+    }
+    
+    Variable result() const
+    {
+        if(is_real)
+            return Variable(r, Variable::Real);
+        if(is_big)
+            return make_int(big);
+        return Variable(i, Variable::Int);
+    }
+    
+    char op;
+    int64_t i;
+    big_int big;
+    double r = 0.0;
+    bool is_big = false;
+    bool is_real = false;
+};
+
+// merge partial results pairwise, in a fixed order
+template<class T, class Merge>
+T tree_merge(vector<T>& parts, Merge merge)
+{
+    for(size_t step=1; step < parts.size(); step *= 2)
+        for(size_t i=0; i + step < parts.size(); i += 2*step)
+            merge(parts[i], parts[i+step]);
+    return parts.at(0);
+}
+
+// run fn(chunk, begin, end) over [0,n) in fixed-size chunks, spread over
+// up to the given number of threads; the first exception is rethrown
+template<class F>
+void parallel_chunks(size_t n, unsigned threads, F fn)
+{
+    size_t chunks = (n + PAR_CHUNK - 1) / PAR_CHUNK;
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mtx;
+    auto work = [&]{
+        for(size_t c; (c = next++) < chunks;)
+        {
+            try{
+                Traced t('p', "chunk");
+                fn(c, c * PAR_CHUNK, std::min(n, (c+1) * PAR_CHUNK));
+            }catch(...){
+                std::lock_guard<std::mutex> lock(error_mtx);
+                if(not error)
+                    error = std::current_exception();
+            }
+        }
+    };
+    vector<std::thread> pool;
+    for(size_t t=1; t < std::min<size_t>(threads, chunks); ++t)
+        pool.emplace_back(work);
+    work();
+    for(auto&& t: pool)
+        t.join();
+    if(error)
+        std::rethrow_exception(error);
+}
+
+// xoshiro256** generator, one per context
+struct Random
+{
+    typedef uint64_t result_type;
+    
+    explicit Random(uint64_t s = 0, uint64_t stream = 0)
+    {
+        seed(s, stream);
+    }
+    
+    // expand the seed through splitmix64, distinct streams never collide
+    void seed(uint64_t s, uint64_t stream = 0)
+    {
+        s ^= stream * 0xd1b54a32d192ed03ull;
+        for(auto&& x: state)
+        {
+            uint64_t z = (s += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            x = z ^ (z >> 31);
+        }
+    }
+    
+    static constexpr uint64_t min() { return 0; }
+    static constexpr uint64_t max() { return ~uint64_t(0); }
+    
+    uint64_t operator()()
+    {
+        uint64_t r = rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return r;
+    }
+    
+    // unbiased value in [0,n), Lemire's multiply and reject
+    uint64_t below(uint64_t n)
+    {
+        unsigned __int128 m = (unsigned __int128)(*this)() * n;
+        uint64_t l = (uint64_t)m;
+        if(l < n)
+        {
+            uint64_t t = -n % n;
+            while(l < t)
+            {
+                m = (unsigned __int128)(*this)() * n;
+                l = (uint64_t)m;
+            }
+        }
+        return m >> 64;
+    }
+    
+    // uniform double in [0,1)
+    double real()
+    {
+        return ((*this)() >> 11) * (1.0 / (uint64_t(1) << 53));
+    }
+    
+private:
+    static uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+    
+    uint64_t state[4];
+};
+
+// binary encoding of values, in host byte order
+// used by snapshot/restore
+template<class T>
+void put(string& out, T x)
+{
+    out.append((const char*)&x, sizeof(T));
+}
+
+inline void put_str(string& out, const string& s)
+{
+    put<uint64_t>(out, s.size());
+    out += s;
+}
+
+inline void encode(string& out, const Variable& v)
+{
+    put<uint8_t>(out, v.type);
+    switch(v.type)
+    {
+        case Variable::Int:
+            put<int64_t>(out, boost::any_cast<int64_t>(v.val));
+            break;
+        case Variable::Real:
+            put<double>(out, boost::any_cast<double>(v.val));
+            break;
+        case Variable::Bool:
+            put<uint8_t>(out, boost::any_cast<bool>(v.val));
+            break;
+        case Variable::String:
+            put_str(out, *boost::any_cast<string>(&v.val));
+            break;
+        case Variable::BigInt:
+            put_str(out, boost::any_cast<big_int>(v.val).str());
+            break;
+        case Variable::List:
+        {
+            const Slice& l = *boost::any_cast<Slice>(&v.val);
+            const Column& c = *l.col;
+            put<uint8_t>(out, c.type);
+            put<uint64_t>(out, l.size);
+            switch(c.type)
+            {
+                case Variable::Int:
+                    out.append((const char*)(c.ints.data() + l.offset),
+                        l.size * sizeof(int64_t));
+                    break;
+                case Variable::Real:
+                    out.append((const char*)(c.reals.data() + l.offset),
+                        l.size * sizeof(double));
+                    break;
+                case Variable::Bool:
+                    out.append(c.bools.data() + l.offset, l.size);
+                    break;
+                default:
+                    for(size_t i=0; i < l.size; ++i)
+                        put_str(out, c.strs[l.offset + i]);
+                    break;
+            }
+            break;
+        }
+        default:
+            throw std::runtime_error((boost::format(
+                "cannot encode %s values"
+                ) % type_names()[v.type]
+            ).str());
+    }
+}
+
+// bounds-checked cursor over encoded values
+struct Reader
+{
+    Reader(const char* b, size_t n):
+        p(b),
+        e(b + n)
+    {}
+    
+    const char* take(size_t n)
+    {
+        if(n > (size_t)(e - p))
+            throw std::runtime_error("truncated or corrupt data");
+        const char* r = p;
+        p += n;
+        return r;
+    }
+    
+    template<class T>
+    T get()
+    {
+        T x;
+        memcpy(&x, take(sizeof(T)), sizeof(T));
+        return x;
+    }
+    
+    string get_str()
+    {
+        size_t n = get<uint64_t>();
+        return string(take(n), n);
+    }
+    
+    Variable value()
+    {
+        auto type = (Variable::ID)get<uint8_t>();
+        switch(type)
+        {
+            case Variable::Int:
+                return Variable(get<int64_t>(), type);
+            case Variable::Real:
+                return Variable(get<double>(), type);
+            case Variable::Bool:
+                return Variable(bool(get<uint8_t>()), type);
+            case Variable::String:
+                return Variable(get_str(), type);
+            case Variable::BigInt:
+                return Variable(big_int(get_str()), type);
+            case Variable::List:
+            {
+                auto col = std::make_shared<Column>();
+                col->type = (Variable::ID)get<uint8_t>();
+                size_t n = get<uint64_t>();
+                switch(col->type)
+                {
+                    case Variable::Int:
+                    {
+                        const char* d = take(n * sizeof(int64_t));
+                        col->ints.resize(n);
+                        memcpy(col->ints.data(), d, n * sizeof(int64_t));
+                        break;
+                    }
+                    case Variable::Real:
+                    {
+                        const char* d = take(n * sizeof(double));
+                        col->reals.resize(n);
+                        memcpy(col->reals.data(), d, n * sizeof(double));
+                        break;
+                    }
+                    case Variable::Bool:
+                    {
+                        const char* d = take(n);
+                        col->bools.assign(d, d + n);
+                        break;
+                    }
+                    case Variable::String:
+                        col->strs.reserve(n);
+                        for(size_t i=0; i < n; ++i)
+                            col->strs.push_back(get_str());
+                        break;
+                    default:
+                        throw std::runtime_error("truncated or corrupt data");
+                }
+                Slice l;
+                l.size = n;
+                l.col = move(col);
+                return Variable(move(l), type);
+            }
+            default:
+                throw std::runtime_error("truncated or corrupt data");
+        }
+    }
+    
+    const char* p;
+    const char* e;
+};
+
+static const char SNAPSHOT_MAGIC[] = "IOX1";
+
+// a variable in a restored snapshot, decoded on first use
+struct Lazy
+{
+    std::shared_ptr<File> file;
+    size_t offset;
+    size_t size;
+};
+
+// front of a stream moved out to a scratch file under --max-mem
+// written in segments and only ever appended to, so streams copied from
+// one another can share it, each knowing how many segments are its own;
+// a copy that grows past a shared end continues in a new spill on top
+struct Spill
+{
+    std::shared_ptr<File> file;
+    size_t bytes = 0;
+    vector<pair<size_t, size_t>> segs; // end offset, values in segment
+    std::shared_ptr<const Spill> base;
+    size_t base_segs = 0;
+    
+    // decode the first n segments in order, one at a time,
+    // giving up early once *stop is set
+    template<class F>
+    void read(size_t n, F f, const bool* stop = nullptr) const
+    {
+        if(base)
+            base->read(base_segs, f, stop);
+        vector<Variable> vals;
+        string buf;
+        size_t at = 0;
+        for(size_t i=0; i < n && not (stop && *stop); ++i)
+        {
+            buf.resize(segs[i].first - at);
+            for(size_t got = 0; got < buf.size();)
+            {
+                ssize_t r = pread(file->fd, &buf[got],
+                    buf.size() - got, at + got);
+                if(r < 0 && errno == EINTR)
+                    continue;
+                if(r <= 0)
+                    throw std::runtime_error("unable to read spilled stream");
+                got += r;
+            }
+            Reader rd(buf.data(), buf.size());
+            vals.clear();
+            for(size_t j=0; j < segs[i].second; ++j)
+                vals.push_back(rd.value());
+            f(vals);
+            at = segs[i].first;
+        }
+    }
+};
+
+// a level of the stream stack; with a spill, its first values are in
+// the file and the vector holds those after them, never empty
+struct Stream: vector<Variable>
+{
+    Stream() = default;
+    Stream(vector<Variable> v):
+        vector<Variable>(move(v))
+    {}
+    Stream(const Stream&) = default;
+    Stream& operator=(const Stream&) = default;
+    Stream(Stream&& s):
+        vector<Variable>(move(s)),
+        spill(move(s.spill)),
+        segs(s.segs),
+        spilled(s.spilled)
+    {
+        s.drop();
+    }
+    Stream& operator=(Stream&& s)
+    {
+        vector<Variable>::operator=(move(s));
+        spill = move(s.spill);
+        segs = s.segs;
+        spilled = s.spilled;
+        s.drop();
+        return *this;
+    }
+    Stream& operator=(vector<Variable> v)
+    {
+        vector<Variable>::operator=(move(v));
+        drop();
+        return *this;
+    }
+    
+    void clear()
+    {
+        vector<Variable>::clear();
+        drop();
+    }
+    void drop()
+    {
+        spill.reset();
+        segs = 0;
+        spilled = 0;
+    }
+    
+    // values in the spill, then in the vector, one segment at a time
+    // spilled segments are decoded into a scratch vector
+    template<class F>
+    void each_segment(F f, const bool* stop = nullptr)
+    {
+        if(spill)
+            spill->read(segs, f, stop);
+        if(not (stop && *stop))
+            f(static_cast<vector<Variable>&>(*this));
+    }
+    
+    std::shared_ptr<Spill> spill;
+    size_t segs = 0;
+    size_t spilled = 0; // values in the spill
+};
+
+// distinct values of a stream in first-seen order, with occurrence counts
+struct Tally
+{
+    // ints, reals and bools go by their bytes, which fit in a short
+    // string's own buffer, io handles by identity, never reading them
+    static string key(const Variable& v)
+    {
+        string k(1, char('0' + v.type));
+        switch(v.type)
+        {
+            case Variable::Int:
+            {
+                int64_t x = boost::any_cast<int64_t>(v.val);
+                k.append((const char*)&x, sizeof(x));
+                break;
+            }
+            case Variable::Real:
+            {
+                // a whole real is keyed as the int it equals, as == has it
+                double x = boost::any_cast<double>(v.val);
+                if(x == std::floor(x) && std::isfinite(x))
+                {
+                    if(x >= -9223372036854775808.0 && x < 9223372036854775808.0)
+                        return key(Variable(int64_t(x), Variable::Int));
+                    return key(make_int(big_int(x)));
+                }
+                // all nans are one value
+                if(std::isnan(x))
+                    x = std::numeric_limits<double>::quiet_NaN();
+                k.append((const char*)&x, sizeof(x));
+                break;
+            }
+            case Variable::Bool:
+                k += boost::any_cast<bool>(v.val) ? '1' : '0';
+                break;
+            case Variable::String:
+                k += *boost::any_cast<string>(&v.val);
+                break;
+            case Variable::IO:
+            {
+                const File* f = boost::any_cast<std::shared_ptr<File>>(&v.val)->get();
+                k.append((const char*)&f, sizeof(f));
+                break;
+            }
+            default:
+                k += to_str(v);
+                break;
+        }
+        return k;
+    }
+    
+    void add(const Variable& v, size_t n = 1)
+    {
+        auto r = index.emplace(key(v), values.size());
+        if(r.second)
+        {
+            values.push_back(v);
+            counts.push_back(n);
+        }
+        else
+            counts[r.first->second] += n;
+    }
+    
+    // combine partial tallies, e.g. from separate chunks of a stream
+    void merge(const Tally& t)
+    {
+        for(size_t i=0; i < t.values.size(); ++i)
+            add(t.values[i], t.counts[i]);
+    }
+    
+    unordered_map<string, size_t> index;
+    vector<Variable> values;
+    vector<size_t> counts;
+};
+
+inline bool is_number(const Variable& v)
+{
+    return is_integer(v) || v.type == Variable::Real;
+}
+
+// ordering for sort: numbers by value, ranked with Int among the other
+// types, then everything else by type first, then by value
+inline bool less_than(const Variable& a, const Variable& b)
+{
+    if(a.type != b.type)
+    {
+        if(is_integer(a) && is_integer(b))
+            return to_big(a) < to_big(b);
+        if(is_number(a) && is_number(b))
+            return to_real(a) < to_real(b);
+        auto rank = [](const Variable& v){
+            return is_number(v) ? Variable::Int : v.type;
+        };
+        return rank(a) < rank(b);
+    }
+    switch(a.type)
+    {
+        case Variable::String:
+            return *boost::any_cast<string>(&a.val) <
+                *boost::any_cast<string>(&b.val);
+        case Variable::Int:
+            return boost::any_cast<int64_t>(a.val) < boost::any_cast<int64_t>(b.val);
+        case Variable::Real:
+            return boost::any_cast<double>(a.val) < boost::any_cast<double>(b.val);
+        case Variable::Bool:
+            return boost::any_cast<bool>(a.val) < boost::any_cast<bool>(b.val);
+        case Variable::BigInt:
+            return boost::any_cast<big_int>(a.val) <
+                boost::any_cast<big_int>(b.val);
+        case Variable::List:
+            return to_str(a) < to_str(b);
+        case Variable::IO:
+            return boost::any_cast<std::shared_ptr<File>>(a.val)->path <
+                boost::any_cast<std::shared_ptr<File>>(b.val)->path;
+        default:
+            assert(false);
+            break;
+    }
+    return false;
+}
+
+// stable LSD radix sort of int keys, returns the sorted permutation
+inline vector<size_t> radix_order(const vector<int64_t>& keys)
+{
+    const uint64_t sign = uint64_t(1) << 63;
+    size_t n = keys.size();
+    vector<size_t> order(n), tmp(n);
+    for(size_t i=0; i < n; ++i)
+        order[i] = i;
+    
+    // skip passes over bytes that are the same in every key
+    uint64_t diff = 0;
+    for(size_t i=1; i < n; ++i)
+        diff |= (uint64_t)keys[i] ^ (uint64_t)keys[0];
+    
+    for(unsigned shift=0; shift < 64; shift += 8)
+    {
+        if(not (diff >> shift & 0xff))
+            continue;
+        size_t buckets[257] = {0};
+        for(size_t i=0; i < n; ++i)
+            ++buckets[(((uint64_t)keys[i] ^ sign) >> shift & 0xff) + 1];
+        for(unsigned b=0; b < 256; ++b)
+            buckets[b+1] += buckets[b];
+        for(size_t i=0; i < n; ++i)
+        {
+            size_t o = order[i];
+            tmp[buckets[((uint64_t)keys[o] ^ sign) >> shift & 0xff]++] = o;
+        }
+        order.swap(tmp);
+    }
+    return order;
+}
+
+// radix_order key ordered like the double, negatives have every bit
+// flipped and the rest only the sign, -0 sorts as 0
+inline int64_t real_key(double x)
+{
+    const uint64_t sign = uint64_t(1) << 63;
+    if(x == 0)
+        x = 0;
+    uint64_t u;
+    memcpy(&u, &x, sizeof(u));
+    u = u & sign ? ~u : u ^ sign;
+    return (int64_t)(u ^ sign);
+}
+
+// stable merge sort, halves sorted on separate threads
+template<class It, class Cmp>
+void parallel_stable_sort(It b, It e, Cmp cmp, unsigned threads)
+{
+    size_t n = e - b;
+    if(threads < 2 || n < (1 << 15))
+    {
+        std::stable_sort(b, e, cmp);
+        return;
+    }
+    It m = b + n/2;
+    std::thread t([=]{ parallel_stable_sort(b, m, cmp, threads/2); });
+    parallel_stable_sort(m, e, cmp, threads - threads/2);
+    t.join();
+    std::inplace_merge(b, m, e, cmp);
+}
+
+// compiled regex, or a plain substring when the pattern has no metachars
+struct Pattern
+{
+    Pattern(const string& s):
+        literal(s.find_first_of("\\^$.|?*+()[]{}") == string::npos),
+        text(s)
+    {
+        // literals keep a regex too, for sub replacements that use $&
+        re = literal ? boost::regex(s, boost::regex::literal) : boost::regex(s);
+    }
+    
+    bool search(const string& s) const
+    {
+        if(literal)
+            return s.find(text) != string::npos;
+        return boost::regex_search(s, re);
+    }
+    
+    bool literal;
+    string text;
+    boost::regex re;
+};
+
+struct Context
+{
+    bool inter = false;
+    unsigned ln = 0;
+    unsigned tok = 0;
+    
+    // running block, its program counter and pending jmp target
+    vector<Line>* m_Block = nullptr;
+    size_t m_PC = 0;
+    size_t m_Jump = 0;
+    bool m_Jumped = false;
+    
+    // cleared by builtins like ? to skip the rest of the line and its block
+    bool cond = true;
+    
+    Random m_Random{std::random_device()()};
+    
+    // where out and dbg write, embedders may point this elsewhere
+    std::ostream* m_Out = &std::cout;
+    
+    // streams at least this long are reduced across par_threads threads
+    size_t par_threshold = 1 << 16;
+    unsigned par_threads = std::max(1u, std::thread::hardware_concurrency());
+    
+    Stream m_Cycled;
+    stack<Stream> m_Stream;
+    unordered_map<string, Stream> m_Stack;
+    unordered_map<string, Lazy> m_Lazy;
+    // variables set by running user functions, one map per call
+    vector<unordered_map<string, Stream>> m_Frames;
+    
+    // --max-mem: past this many bytes, the coldest variables are spilled
+    // to scratch files and decoded again when next used, then the front
+    // of a stream still being produced; 0 is no limit
+    size_t max_mem = 0;
+    struct Use
+    {
+        size_t bytes;
+        uint64_t tick;
+    };
+    unordered_map<string, Use> m_Use; // only kept with max_mem
+    size_t m_VarBytes = 0;
+    uint64_t m_Tick = 0;
+    std::unordered_map<std::string, Mark> m_Marks;
+    unordered_map<string, function<void()>> m_Funcs;
+    unordered_map<string, iox::Native> m_Natives;
+    unordered_map<string, UserFunction> m_Users;
+    Stats m_Stats;
+    unordered_map<string, Pattern> m_Patterns;
+
+    Context(const Context&) = default;
+    Context& operator=(const Context&) = default;
+    Context(Context&&) = default;
+    Context& operator=(Context&&) = default;
+
+    void track_depth()
+    {
+        m_Stats.peak_depth = std::max(m_Stats.peak_depth, m_Stream.size());
+    }
+
+    void recycle()
+    {
+        flush();
+        m_Stream.push(move(m_Cycled));
+        m_Cycled.clear();
+        track_depth();
+    }
+    
+    void cycle()
+    {
+        if(m_Stream.empty())
+        {
+            m_Stream.push(vector<Variable>());
+            track_depth();
+        }
+        else if(not m_Stream.top().empty())
+        {
+            // an empty stream does not replace the cycled values,
+            // so _ still recalls the pipe from before the line started
+            m_Cycled = move(m_Stream.top());
+            m_Stream.top().clear();
+        }
+    }
+    
+    void flush()
+    {
+        if(m_Stream.empty())
+        {
+            m_Stream.push(vector<Variable>());
+            track_depth();
+        }
+        else
+            m_Stream.top().clear();
+    }
+    
+    bool append=false;
+    
+    // drop stream levels left under the top, e.g. by lines starting with _
+    void settle()
+    {
+        if(m_Stream.size() <= 1)
+            return;
+        auto top = move(m_Stream.top());
+        kit::clear(m_Stream);
+        m_Stream.push(move(top));
+    }
+    
+    void push_stream()
+    {
+        m_Stream.push(vector<Variable>());
+        track_depth();
+    }
+    void pop_stream()
+    {
+        m_Stream.pop();
+    }
+    
+    void clear()
+    {
+        kit::clear(m_Stream);
+        kit::clear(m_Stack);
+        kit::clear(m_Lazy);
+        kit::clear(m_Use);
+        m_VarBytes = 0;
+        flush();
+    }
+
+    void choice()
+    {
+        auto& st = m_Stream.top();
+        if(st.empty())
+            throw std::out_of_range("choice of empty stream");
+        Variable v = move(st[m_Random.below(st.size())]);
+        flush();
+        m_Stream.top().push_back(move(v));
+    }
+    
+    // start, end[, n] -> n random values in [start,end]
+    // ints are uniform over the range, reals over [start,end)
+    void randint()
+    {
+        auto& st = m_Stream.top();
+        int64_t n = 1;
+        if(st.size() > 2)
+            n = boost::any_cast<int64_t>(st.at(2).val);
+        if(n < 0)
+            throw std::out_of_range("rand count out of range");
+        
+        if(st.at(0).type == Variable::Real || st.at(1).type == Variable::Real)
+        {
+            double s = to_real(st[0]);
+            double w = to_real(st[1]) - s;
+            flush();
+            m_Stream.top().reserve(n);
+            for(int64_t i=0; i < n; ++i)
+                push<double>(s + w * m_Random.real(), Variable::Real);
+            return;
+        }
+        
+        int64_t s = boost::any_cast<int64_t>(st.at(0).val);
+        int64_t e = boost::any_cast<int64_t>(st.at(1).val);
+        if(e < s)
+            std::swap(s, e);
+        uint64_t span = (uint64_t)e - (uint64_t)s + 1; // 0 is the full range
+        flush();
+        m_Stream.top().reserve(n);
+        for(int64_t i=0; i < n; ++i)
+        {
+            uint64_t r = span ? m_Random.below(span) : m_Random();
+            push<int64_t>((int64_t)((uint64_t)s + r), Variable::Int);
+        }
+    }
+    
+    void shuffle()
+    {
+        auto& st = m_Stream.top();
+        for(size_t i = st.size(); i > 1; --i)
+            std::swap(st[i-1], st[m_Random.below(i)]);
+    }
+    
+    // values..., k -> k values picked without replacement
+    void sample()
+    {
+        auto& st = m_Stream.top();
+        if(st.empty() || st.back().type != Variable::Int)
+            throw std::runtime_error("sample requires a count");
+        int64_t k = boost::any_cast<int64_t>(st.back().val);
+        st.pop_back();
+        if(k < 0)
+            throw std::out_of_range("sample count out of range");
+        size_t n = std::min<size_t>(k, st.size());
+        
+        // partial Fisher-Yates, only the front n are drawn
+        for(size_t i=0; i < n; ++i)
+            std::swap(st[i], st[i + m_Random.below(st.size() - i)]);
+        st.resize(n, Variable(int64_t(0), Variable::Int));
+    }
+        
+    void sleep()
+    {
+        int64_t sec = boost::any_cast<int64_t>(m_Stream.top().at(0).val);
+        flush();
+        auto t = std::chrono::steady_clock::now();
+        {
+            Traced trace('i', "sleep");
+            std::this_thread::sleep_for(std::chrono::seconds(sec));
+        }
+        m_Stats.blocked += std::chrono::steady_clock::now() - t;
+    }
+    
+    void in()
+    {
+        if(not m_Stream.top().empty())
+            out("", false);
+        string line;
+        auto t = std::chrono::steady_clock::now();
+        {
+            Traced trace('i', "stdin");
+            std::getline(cin, line);
+        }
+        m_Stats.blocked += std::chrono::steady_clock::now() - t;
+        //char* rl = readline("");
+        //BOOST_SCOPE_EXIT_ALL() {
+        //    free(rl);
+        //};
+        flush();
+        push<string>(line);
+    }
+    
+    void out(
+        std::string sep = "",
+        bool newline = true,
+        bool quotestrings = false
+    ){
+        if(m_Stream.top().spill)
+        {
+            // print segment by segment, leaving the stream as it was
+            auto st = move(m_Stream.top());
+            BOOST_SCOPE_EXIT_ALL(&) {
+                m_Stream.top() = move(st);
+            };
+            bool first = true;
+            st.each_segment([&](vector<Variable>& vals){
+                if(not first && not vals.empty())
+                    *m_Out << sep;
+                first = false;
+                static_cast<vector<Variable>&>(m_Stream.top()).swap(vals);
+                out(sep, false, quotestrings);
+                static_cast<vector<Variable>&>(m_Stream.top()).swap(vals);
+            });
+            if(newline)
+                *m_Out << endl;
+            return;
+        }
+        try{
+            auto& s = m_Stream.top();
+            size_t sz = s.size();
+            for(size_t i=0; i < sz; ++i)
+            {
+                if(i) *m_Out << sep;
+                auto& d = s[i].val;
+                
+                switch(s[i].type)
+                {
+                    case Variable::String:
+                        // encode escaped strings
+                        if(quotestrings)
+                            *m_Out << "\'";
+                        *m_Out << boost::any_cast<string>(d);
+                        if(quotestrings)
+                            *m_Out << "\'";
+                        break;
+                    case Variable::Int:
+                        *m_Out << boost::any_cast<int64_t>(d);
+                        break;
+                    case Variable::BigInt:
+                        *m_Out << boost::any_cast<big_int>(d);
+                        break;
+                    case Variable::Real:
+                        *m_Out << real_str(boost::any_cast<double>(d));
+                        break;
+                    case Variable::Bool:
+                    {
+                        bool b = boost::any_cast<bool>(d);
+                        *m_Out << (b?"true":"false");
+                        break;
+                    }
+                    case Variable::List:
+                        *m_Out << to_str(s[i]);
+                        break;
+                    case Variable::IO:
+                        // file contents go straight to stdout
+                        if(m_Out == &std::cout)
+                        {
+                            cout.flush();
+                            boost::any_cast<std::shared_ptr<File>>(d)->send(
+                                STDOUT_FILENO
+                            );
+                        }
+                        else
+                            *m_Out << to_str(s[i]);
+                        break;
+                    default:
+                        assert(false);
+                        break;
+                };
+            }
+            if(newline)
+                *m_Out << endl;
+        }catch(const std::out_of_range&){
+            if(newline)
+                *m_Out << endl;
+        }catch(const boost::bad_any_cast&){
+            assert(false);
+        }
+    }
+    
+    void seq()
+    {
+        int64_t st = boost::any_cast<int64_t>(m_Stream.top().at(0).val);
+        int64_t en;
+        try{
+            en = boost::any_cast<int64_t>(m_Stream.top().at(1).val);
+        }catch(const std::out_of_range&){
+            // if only 1 arg, seq 5 is range [0,5)
+            en = st;
+            st = 1;
+        }
+        int64_t inc = st <= en ? 1 : -1;
+        TRY(inc = boost::any_cast<int64_t>(m_Stream.top().at(2).val));
+        // a step of 0 or away from the end would never get there
+        if(inc == 0 || (en > st && inc < 0) || (en < st && inc > 0))
+            throw std::out_of_range("seq step out of range");
+        // adjust end point
+        flush();
+        for(int64_t i=st; inc > 0 ? i <= en : i >= en;)
+        {
+            push<int64_t>(i, Variable::Int);
+            grown();
+            // stepping past the int64_t range ends the sequence
+            if(__builtin_add_overflow(i, inc, &i))
+                break;
+        }
+    }
+    
+    std::shared_ptr<File> as_io(Variable& v)
+    {
+        if(v.type != Variable::IO)
+            throw std::runtime_error((boost::format(
+                "expected io, got %s"
+                ) % type_names()[v.type]
+            ).str());
+        return boost::any_cast<std::shared_ptr<File>>(v.val);
+    }
+    
+    // paths...[, mode] -> io handles, mode is 'r' (default), 'w' or 'a'
+    void open()
+    {
+        auto st = move(m_Stream.top());
+        flush();
+        int flags = O_RDONLY;
+        // the last string is a mode only when it is one, else a path
+        if(st.size() > 1 && st.back().type == Variable::String)
+        {
+            const string& mode = as_str(st.back());
+            if(mode == "w")
+                flags = O_WRONLY | O_CREAT | O_TRUNC;
+            else if(mode == "a")
+                flags = O_WRONLY | O_CREAT | O_APPEND;
+            if(flags != O_RDONLY || mode == "r")
+                st.pop_back();
+        }
+        for(auto&& v: st)
+            push<std::shared_ptr<File>>(
+                std::make_shared<File>(as_str(v), flags), Variable::IO
+            );
+    }
+    
+    // collect output of every process in the stream in one pass
+    void drain(vector<Variable>& st)
+    {
+        vector<File*> procs;
+        for(auto&& v: st)
+            if(v.type == Variable::IO)
+            {
+                File* f = boost::any_cast<std::shared_ptr<File>>(v.val).get();
+                if(f->process() && not f->mapped)
+                    procs.push_back(f);
+            }
+        if(procs.empty())
+            return;
+        std::sort(ENTIRE(procs));
+        procs.erase(std::unique(ENTIRE(procs)), procs.end());
+        auto t = std::chrono::steady_clock::now();
+        File::drain(procs);
+        m_Stats.blocked += std::chrono::steady_clock::now() - t;
+    }
+    
+    // commands... -> io handles, the commands run concurrently
+    void spawn()
+    {
+        auto st = move(m_Stream.top());
+        flush();
+        for(auto&& v: st)
+            push<std::shared_ptr<File>>(
+                std::make_shared<File>(as_str(v), string()), Variable::IO
+            );
+    }
+    
+    // lines..., command -> output lines of command, fed lines as stdin
+    void run_cmd()
+    {
+        auto st = move(m_Stream.top());
+        flush();
+        string cmd = pop_str(st);
+        string input;
+        for(auto&& v: st)
+        {
+            input += to_str(v);
+            input += '\n';
+        }
+        Variable p(std::make_shared<File>(cmd, input), Variable::IO);
+        m_Stream.top().push_back(move(p));
+        lines();
+    }
+    
+    // io -> whole contents as one string
+    void read()
+    {
+        auto st = move(m_Stream.top());
+        drain(st);
+        flush();
+        for(auto&& v: st)
+            push<string>(to_str(v));
+    }
+    
+    // io -> one string per line, scanned straight from the mapping
+    void lines()
+    {
+        auto st = move(m_Stream.top());
+        drain(st);
+        flush();
+        for(auto&& v: st)
+        {
+            auto f = as_io(v);
+            f->map();
+            const char* p = f->data;
+            const char* e = f->data + f->size;
+            while(p < e)
+            {
+                const char* nl = (const char*)memchr(p, '\n', e - p);
+                if(not nl)
+                    nl = e;
+                push<string>(string(p, nl));
+                grown();
+                p = nl + 1;
+            }
+        }
+    }
+    
+    // processes -> exit status of each once its output is collected
+    void status()
+    {
+        auto st = move(m_Stream.top());
+        drain(st);
+        flush();
+        for(auto&& v: st)
+        {
+            auto f = as_io(v);
+            if(not f->process())
+                throw std::runtime_error("\'" + f->path + "\' is not a process");
+            push<int64_t>(f->status, Variable::Int);
+        }
+    }
+    
+    // values..., io -> writes each value as a line, io values are copied whole
+    void write()
+    {
+        auto st = move(m_Stream.top());
+        flush();
+        if(st.empty())
+            throw std::out_of_range("write requires an io handle");
+        auto out = as_io(st.back());
+        st.pop_back();
+        drain(st);
+        // lines go out in large chunks, flushed ahead of any io copied in
+        string buf;
+        for(auto&& v: st)
+        {
+            if(v.type == Variable::IO)
+            {
+                write_all(out->fd, buf.data(), buf.size());
+                buf.clear();
+                as_io(v)->send(out->fd);
+                continue;
+            }
+            buf += to_str(v);
+            buf += '\n';
+            if(buf.size() >= 1 << 20)
+            {
+                write_all(out->fd, buf.data(), buf.size());
+                buf.clear();
+            }
+        }
+        write_all(out->fd, buf.data(), buf.size());
+        push<std::shared_ptr<File>>(out, Variable::IO);
+    }
+    
+    // the stream's only value, if it is a list
+    const Slice* single_list()
+    {
+        auto& st = m_Stream.top();
+        if(st.spill || st.size() != 1 || st[0].type != Variable::List)
+            return nullptr;
+        return boost::any_cast<Slice>(&st[0].val);
+    }
+    
+    // values of one type -> list
+    void pack()
+    {
+        auto st = move(m_Stream.top());
+        flush();
+        auto col = std::make_shared<Column>();
+        if(not st.empty())
+            col->type = st[0].type;
+        for(auto&& v: st)
+        {
+            if(v.type == Variable::BigInt)
+                throw std::runtime_error((boost::format(
+                    "lists cannot hold ints beyond 64 bits, got %s"
+                    ) % to_str(v)
+                ).str());
+            if(v.type != col->type)
+                throw std::runtime_error((boost::format(
+                    "list of %s cannot hold %s"
+                    ) % type_names()[col->type] % type_names()[v.type]
+                ).str());
+            switch(v.type)
+            {
+                case Variable::Int:
+                    col->ints.push_back(boost::any_cast<int64_t>(v.val));
+                    break;
+                case Variable::Real:
+                    col->reals.push_back(boost::any_cast<double>(v.val));
+                    break;
+                case Variable::String:
+                    col->strs.push_back(move(as_str(v)));
+                    break;
+                case Variable::Bool:
+                    col->bools.push_back(boost::any_cast<bool>(v.val));
+                    break;
+                case Variable::List:
+                    throw std::runtime_error("lists cannot be nested");
+                default:
+                    throw std::runtime_error((boost::format(
+                        "lists cannot hold %s"
+                        ) % type_names()[v.type]
+                    ).str());
+            }
+        }
+        Slice l;
+        l.size = st.size();
+        l.col = move(col);
+        push<Slice>(move(l), Variable::List);
+    }
+    
+    // list -> its values
+    void unpack()
+    {
+        auto st = move(m_Stream.top());
+        flush();
+        for(auto&& v: st)
+        {
+            if(v.type != Variable::List)
+            {
+                m_Stream.top().push_back(move(v));
+                continue;
+            }
+            const Slice& l = *boost::any_cast<Slice>(&v.val);
+            m_Stream.top().reserve(m_Stream.top().size() + l.size);
+            for(size_t i=0; i < l.size; ++i)
+            {
+                ++m_Stats.allocs;
+                m_Stream.top().push_back(l.at(i));
+            }
+        }
+    }
+    
+    void length()
+    {
+        const Slice* l = single_list();
+        auto& st = m_Stream.top();
+        int64_t len = l ? l->size : st.spilled + st.size();
+        flush();
+        push<int64_t>(len, Variable::Int);
+    }
+    
+    void flip()
+    {
+        std::reverse(ENTIRE(m_Stream.top()));
+    }
+    
+    void rev()
+    {
+        // reverse in place, no copies out of the any
+        for(auto&& v: m_Stream.top())
+        {
+            string* s = boost::any_cast<string>(&v.val);
+            if(not s)
+                throw std::runtime_error("rev expects strings");
+            std::reverse(ENTIRE(*s));
+        }
+    }
+
+    void abs()
+    {
+        auto& s = m_Stream.top();
+        size_t sz = s.size();
+        for(size_t i=0; i < sz; ++i)
+        {
+            auto& d = s[i].val;
+            switch(s[i].type)
+            {
+                case Variable::Int:
+                {
+                    int64_t x = boost::any_cast<int64_t>(d);
+                    if(x == std::numeric_limits<int64_t>::min())
+                    {
+                        // -x does not fit
+                        s[i] = make_int(-big_int(x));
+                        break;
+                    }
+                    d = boost::any(std::abs(x));
+                    break;
+                }
+                case Variable::Real:
+                {
+                    d = boost::any(std::abs(boost::any_cast<double>(d)));
+                    break;
+                }
+                case Variable::BigInt:
+                {
+                    d = boost::any(big_int(boost::multiprecision::abs(boost::any_cast<big_int>(d))));
+                    break;
+                }
+                default:
+                    throw std::runtime_error((boost::format(
+                        "cannot use %s in arithmetic"
+                        ) % type_names()[s[i].type]
+                    ).str());
+            };
+        }
+    }
+    
+    //void each(const std::function<unsigned, boost::any>& cb)
+    //{
+    //    auto& s = m_Stream.top();
+    //    size_t sz = s.size();
+    //    for(unsigned i=0; i < sz; ++i)
+    //        cb(i, s[i]);
+    //}
+    
+    void cast_int()
+    {
+        auto& s = m_Stream.top();
+        size_t sz = s.size();
+        for(size_t i=0; i < sz; ++i)
+        {
+            auto& d = s[i].val;
+            
+            switch(s[i].type)
+            {
+                case Variable::String:
+                {
+                    const string& str = *boost::any_cast<string>(&d);
+                    try{
+                        d = boost::any(boost::lexical_cast<int64_t>(str));
+                    }catch(const boost::bad_lexical_cast&){
+                        // too wide for int64_t, promote like a literal
+                        bool neg = not str.empty() && str[0] == '-';
+                        if(str.size() <= size_t(neg) ||
+                            str.find_first_not_of("0123456789", neg) != string::npos)
+                            throw;
+                        s[i] = make_int(big_int(str));
+                        continue;
+                    }
+                    break;
+                }
+                case Variable::Int:
+                case Variable::BigInt:
+                    // already int
+                    continue;
+                case Variable::Real:
+                {
+                    double f = boost::any_cast<double>(d);
+                    f = (f > 0.0) ? (f + 0.5) : (f - 0.5);
+                    // also false for nan
+                    if(not (f >= -9223372036854775808.0 && f < 9223372036854775808.0))
+                        throw std::runtime_error((boost::format(
+                            "%s is out of int range"
+                            ) % real_str(boost::any_cast<double>(d))
+                        ).str());
+                    d = boost::any((int64_t)f);
+                    break;
+                }
+                case Variable::Bool:
+                {
+                    bool b = boost::any_cast<bool>(d);
+                    d = boost::any(int64_t(b?1:0));
+                    break;
+                }
+                default:
+                    throw std::runtime_error((boost::format(
+                        "cannot cast %s to int"
+                        ) % type_names()[s[i].type]
+                    ).str());
+            };
+            s[i].type = Variable::Int;
+        }
+    }
+    
+    void cast_real()
+    {
+        for(auto&& v: m_Stream.top())
+        {
+            switch(v.type)
+            {
+                case Variable::Real:
+                    continue;
+                case Variable::Int:
+                    v.val = boost::any((double)boost::any_cast<int64_t>(v.val));
+                    break;
+                case Variable::BigInt:
+                    v.val = boost::any(
+                        boost::any_cast<big_int>(v.val).convert_to<double>()
+                    );
+                    break;
+                case Variable::Bool:
+                    v.val = boost::any(boost::any_cast<bool>(v.val) ? 1.0 : 0.0);
+                    break;
+                case Variable::String:
+                    v.val = boost::any(lexical_cast<double>(as_str(v)));
+                    break;
+                default:
+                    throw std::runtime_error((boost::format(
+                        "cannot cast %s to real"
+                        ) % type_names()[v.type]
+                    ).str());
+            }
+            v.type = Variable::Real;
+        }
+    }
+    void cast_str()
+    {
+        for(auto&& v: m_Stream.top())
+        {
+            if(v.type == Variable::String)
+                continue;
+            v.val = boost::any(to_str(v));
+            v.type = Variable::String;
+        }
+    }
+    // apply fn to every stream value, in parallel for long streams
+    template<class F>
+    void each_value(F fn)
+    {
+        auto& st = m_Stream.top();
+        if(st.size() < par_threshold)
+        {
+            for(auto&& v: st)
+                fn(v);
+            return;
+        }
+        parallel_chunks(st.size(), par_threads, [&](size_t, size_t b, size_t e){
+            for(size_t i=b; i < e; ++i)
+                fn(st[i]);
+        });
+    }
+    
+    void cast_bool(){
+        each_value([](Variable& v){
+            auto& d = v.val;
+            
+            switch(v.type)
+            {
+                case Variable::String:
+                {
+                    d = boost::any(not boost::any_cast<string>(&d)->empty());
+                    break;
+                }
+                case Variable::Int:
+                {
+                    d = boost::any(!! boost::any_cast<int64_t>(d));
+                    break;
+                }
+                case Variable::Real:
+                {
+                    d = boost::any(boost::any_cast<double>(d) != 0.0);
+                    break;
+                }
+                case Variable::BigInt:
+                    // never zero, zero fits in int64_t
+                    d = boost::any(true);
+                    break;
+                case Variable::Bool:
+                    // already bool
+                    break;
+                default:
+                    throw std::runtime_error((boost::format(
+                        "cannot cast %s to bool"
+                        ) % type_names()[v.type]
+                    ).str());
+            };
+            v.type = Variable::Bool;
+        });
+    }
+    
+    void q()
+    {
+        cast_bool();
+        auto& st = m_Stream.top();
+        cond = not st.empty() && boost::any_cast<bool>(st[0].val);
+    }
+    
+    template<class T>
+    bool cmpt(std::vector<Variable>& st)
+    {
+        size_t sz = st.size();
+        bool wrong_type = false;
+        bool good = true;
+        try{
+            if(sz >= par_threshold)
+            {
+                // every value against the first, chunks stop at a mismatch
+                const T first = boost::any_cast<T>(st[0].val);
+                std::atomic<bool> same(true);
+                parallel_chunks(sz, par_threads, [&](size_t, size_t b, size_t e){
+                    for(size_t i=b; i < e && same; ++i)
+                    {
+                        const T* p = boost::any_cast<T>(&st[i].val);
+                        if(not p)
+                            throw boost::bad_any_cast();
+                        if(*p != first)
+                            same = false;
+                    }
+                });
+                good = same;
+                sz = 0;
+            }
+            T last = T();
+            for(size_t i=0; i < sz; ++i)
+            {
+                T b = boost::any_cast<T>(st[i].val);
+                if(i)
+                {
+                    if(b != last)
+                    {
+                        good = false;
+                        break;
+                    }
+                }
+                last = b;
+            }
+        }catch(const std::out_of_range&){
+        }catch(const boost::bad_any_cast&){
+            wrong_type = true;
+        }
+        if(not wrong_type)
+        {
+            flush();
+            push<bool>(good, Variable::Bool);
+            return true;
+        }
+        return false;
+    }
+        
+    void gt() {}
+    void lt() {}
+    void gte() {}
+    void lte() {}
+    
+    void cmp()
+    {
+        auto st = move(m_Stream.top());
+        if(cmpt<bool>(st))
+            return;
+        if(cmpt<int64_t>(st))
+            return;
+        if(cmpt<double>(st))
+            return;
+        if(cmpt<string>(st))
+            return;
+        
+        // mixed numbers compare by value, exactly when all are integers
+        bool good = true;
+        if(std::all_of(ENTIRE(st), is_number))
+        {
+            if(std::all_of(ENTIRE(st), is_integer))
+            {
+                big_int first = to_big(st[0]);
+                for(size_t i=1; good && i < st.size(); ++i)
+                    good = to_big(st[i]) == first;
+            }
+            else
+            {
+                double first = to_real(st[0]);
+                for(size_t i=1; good && i < st.size(); ++i)
+                    good = to_real(st[i]) == first;
+            }
+            flush();
+            push<bool>(good, Variable::Bool);
+            return;
+        }
+        
+        // other mixed values compare by type and representation
+        for(size_t i=1; i < st.size(); ++i)
+            if(Tally::key(st[i]) != Tally::key(st[0]))
+            {
+                good = false;
+                break;
+            }
+        flush();
+        push<bool>(good, Variable::Bool);
+    }
+    
+    void notop()
+    {
+        cast_bool(); // ensure all stream elements are actually of type bool
+        
+        each_value([](Variable& v){
+            bool* b = boost::any_cast<bool>(&v.val);
+            assert(b);
+            *b = not *b;
+        });
+    }
+    
+    void assert_this()
+    {
+        auto last_st = m_Stream.top();
+        cast_bool();
+        auto st = m_Stream.top();
+        
+        try{
+            size_t sz = st.size();
+            for(size_t i=0; i < sz; ++i)
+            {
+                if(not boost::any_cast<bool>(st[i].val))
+                    throw runtime_error((boost::format(
+                        "assertion failed @ ln %s"
+                    ) % ln).str());
+            }
+        }catch(const std::out_of_range&){
+        }catch(const boost::bad_any_cast&){
+            assert(false);
+        }
+        m_Stream.top() = last_st;
+    }
+    
+    // sum a list straight from its typed buffer
+    void sum_list(const Slice& l)
+    {
+        const Column& c = *l.col;
+        Accum acc('+');
+        switch(c.type)
+        {
+            case Variable::Int:
+            {
+                const int64_t* p = c.ints.data() + l.offset;
+                if(l.size < par_threshold)
+                {
+                    for(size_t i=0; i < l.size; ++i)
+                        acc.add(p[i]);
+                    break;
+                }
+                vector<Accum> parts((l.size + PAR_CHUNK - 1) / PAR_CHUNK, acc);
+                parallel_chunks(l.size, par_threads, [&](size_t n, size_t b, size_t e){
+                    for(size_t i=b; i < e; ++i)
+                        parts[n].add(p[i]);
+                });
+                acc = tree_merge(parts, [](Accum& a, const Accum& b){
+                    a.merge(b);
+                });
+                break;
+            }
+            case Variable::Real:
+            {
+                const double* p = c.reals.data() + l.offset;
+                if(l.size < par_threshold)
+                {
+                    double tot = 0.0;
+                    for(size_t i=0; i < l.size; ++i)
+                        tot += p[i];
+                    acc.add(tot);
+                    break;
+                }
+                vector<double> parts((l.size + PAR_CHUNK - 1) / PAR_CHUNK, 0.0);
+                parallel_chunks(l.size, par_threads, [&](size_t n, size_t b, size_t e){
+                    double tot = 0.0;
+                    for(size_t i=b; i < e; ++i)
+                        tot += p[i];
+                    parts[n] = tot;
+                });
+                acc.add(tree_merge(parts, [](double& a, double b){
+                    a += b;
+                }));
+                break;
+            }
+            default:
+                throw std::runtime_error((boost::format(
+                    "cannot sum list of %s"
+                    ) % type_names()[c.type]
+                ).str());
+        }
+        flush();
+        ++m_Stats.allocs;
+        m_Stream.top().push_back(acc.result());
+    }
+    
+    // fold the stream with +, - or * (- subtracts the rest from the first)
+    // long + and * streams are folded in fixed-size chunks across threads,
+    // so int results are exact and real results do not depend on the
+    // number of threads
+    void arith(char op)
+    {
+        auto st = move(m_Stream.top());
+        flush();
+        Accum acc(op);
+        size_t sz = st.size();
+        if(op != '-' && sz >= par_threshold)
+        {
+            vector<Accum> parts((sz + PAR_CHUNK - 1) / PAR_CHUNK, acc);
+            parallel_chunks(sz, par_threads, [&](size_t n, size_t b, size_t e){
+                for(size_t i=b; i < e; ++i)
+                    parts[n].add(st[i]);
+            });
+            acc = tree_merge(parts, [](Accum& a, const Accum& b){
+                a.merge(b);
+            });
+            sz = 0;
+        }
+        for(size_t i=0; i < sz; ++i)
+        {
+            if(i == 0 && op == '-')
+            {
+                acc.op = '+';
+                acc.add(st[i]);
+                acc.op = '-';
+            }
+            else
+                acc.add(st[i]);
+        }
+        ++m_Stats.allocs;
+        m_Stream.top().push_back(acc.result());
+    }
+    
+    void sum()
+    {
+        if(m_Stream.top().spill)
+            return reduce_spilled(&Context::sum);
+        if(const Slice* l = single_list())
+        {
+            sum_list(*l);
+            return;
+        }
+        arith('+');
+    }
+    void diff() { arith('-'); }
+    void mult()
+    {
+        if(m_Stream.top().spill)
+            return reduce_spilled(&Context::mult);
+        arith('*');
+    }
+    
+    // apply an associative reduction to each segment of a spilled stream,
+    // then to the partial results
+    void reduce_spilled(void (Context::*fn)())
+    {
+        auto st = move(m_Stream.top());
+        flush();
+        vector<Variable> parts;
+        st.each_segment([&](vector<Variable>& vals){
+            m_Stream.top() = move(vals);
+            (this->*fn)();
+            std::move(ENTIRE(m_Stream.top()), back_inserter(parts));
+        });
+        m_Stream.top() = move(parts);
+        (this->*fn)();
+    }
+    
+    // first divided by the rest, integer division unless a real is involved
+    void div()
+    {
+        auto st = move(m_Stream.top());
+        flush();
+        if(st.empty())
+            return;
+        bool real = std::any_of(ENTIRE(st), [](const Variable& v){
+            return v.type == Variable::Real;
+        });
+        if(real)
+        {
+            double tot = to_real(st[0]);
+            for(size_t i=1; i < st.size(); ++i)
+            {
+                double x = to_real(st[i]);
+                if(x == 0.0)
+                    throw std::runtime_error("divide by zero");
+                tot /= x;
+            }
+            push<double>(tot, Variable::Real);
+            return;
+        }
+        
+        for(auto&& v: st)
+            if(not is_integer(v))
+                throw std::runtime_error((boost::format(
+                    "cannot use %s in arithmetic"
+                    ) % type_names()[v.type]
+                ).str());
+        Variable tot = st[0];
+        for(size_t i=1; i < st.size(); ++i)
+        {
+            if(st[i].type == Variable::Int && tot.type == Variable::Int)
+            {
+                int64_t a = boost::any_cast<int64_t>(tot.val);
+                int64_t b = boost::any_cast<int64_t>(st[i].val);
+                if(b == 0)
+                    throw std::runtime_error("divide by zero");
+                if(not (b == -1 && a == std::numeric_limits<int64_t>::min()))
+                {
+                    tot.val = a / b;
+                    continue;
+                }
+            }
+            big_int b = to_big(st[i]);
+            if(b == 0)
+                throw std::runtime_error("divide by zero");
+            tot = make_int(to_big(tot) / b);
+        }
+        ++m_Stats.allocs;
+        m_Stream.top().push_back(tot);
+    }
+
+    //std::string ret()
+    //{
+        
+    //}
+    
+    template<class T>
+    void push(T s, Variable::ID tid = Variable::String)
+    {
+        ++m_Stats.allocs;
+        m_Stream.top().push_back(Variable(s, tid));
+    }
+    
+    template<class T>
+    bool try_push(string s, Variable::ID tid, bool append_this = false)
+    {
+        T cast;
+        try{
+            cast  = lexical_cast<T>(s);
+        }catch(...){
+            return false;
+        }
+
+        if(not append_this)
+        {
+            //if(not m_Stream.top().empty())
+            //{
+            //    throw std::runtime_error((boost::format(
+            //        "literal \'%s\' is not assignable"
+            //    ) % s).str());
+            //}
+
+            cycle();//flush();
+        }
+        
+        push<T>(cast, tid);
+        return true;
+    }
+    
+    void reset()
+    {
+        append = false;
+        clear();
+    }
+    
+    void noop(){}
+    void ncmp(){cmp(); notop();}
+    void out_np(){out();}
+    void dbg(){out(", ", true, true);}
+    void type(){
+        auto st = move(m_Stream.top());
+        for(auto&& t: st)
+            push<string>(type_names()[t.type]);
+    }
+    
+    void front(){
+        const Slice* l = single_list();
+        if(l && not l->size)
+            throw std::out_of_range("list is empty");
+        auto& st = m_Stream.top();
+        if(not l && st.empty())
+            throw std::out_of_range("stream is empty");
+        // a spilled front is read only up to its first value
+        vector<Variable> e;
+        if(l)
+            e.push_back(l->at(0));
+        else
+        {
+            bool done = false;
+            st.each_segment([&](vector<Variable>& vals){
+                if(vals.empty())
+                    return;
+                e.push_back(move(vals[0]));
+                done = true;
+            }, &done);
+        }
+        flush();
+        m_Stream.top().push_back(move(e[0]));
+    }
+    void back(){
+        const Slice* l = single_list();
+        if(l && not l->size)
+            throw std::out_of_range("list is empty");
+        if(not l && m_Stream.top().empty())
+            throw std::out_of_range("stream is empty");
+        auto e = l ? l->at(l->size - 1) : m_Stream.top().back();
+        flush();
+        m_Stream.top().push_back(e);
+    }
+    
+    string& as_str(Variable& v)
+    {
+        string* s = boost::any_cast<string>(&v.val);
+        if(not s)
+            throw std::runtime_error((boost::format(
+                "expected str, got %s"
+                ) % type_names()[v.type]
+            ).str());
+        return *s;
+    }
+    
+    // pop the trailing string argument (separator, needle, etc.)
+    string pop_str(vector<Variable>& st)
+    {
+        if(st.empty())
+            throw std::out_of_range("missing string argument");
+        string* r = boost::any_cast<string>(&st.back().val);
+        if(not r)
+            throw std::runtime_error("expected string argument");
+        string s = move(*r);
+        st.pop_back();
+        return s;
+    }
+    
+    // strings..., sep -> one string
+    void join(){
+        auto st = move(m_Stream.top());
+        flush();
+        string sep = pop_str(st);
+        
+        // size once, then append, so long streams are not recopied
+        size_t total = 0;
+        for(auto&& v: st)
+            total += (v.type == Variable::String) ?
+                boost::any_cast<string>(&v.val)->size() : 16;
+        if(not st.empty())
+            total += sep.size() * (st.size() - 1);
+        
+        string r;
+        r.reserve(total);
+        for(size_t i=0; i < st.size(); ++i)
+        {
+            if(i)
+                r += sep;
+            if(st[i].type == Variable::String)
+                r += *boost::any_cast<string>(&st[i].val);
+            else
+                r += to_str(st[i]);
+        }
+        push<string>(move(r));
+    }
+    
+    void concat(){
+        m_Stream.top().push_back(Variable(string(), Variable::String));
+        join();
+    }
+    
+    // strings..., sep -> pieces of each string
+    void split(){
+        auto st = move(m_Stream.top());
+        flush();
+        string sep = pop_str(st);
+        for(auto&& v: st)
+        {
+            string* s = boost::any_cast<string>(&v.val);
+            if(not s)
+                throw std::runtime_error("split expects strings");
+            if(sep.empty())
+            {
+                for(char c: *s)
+                    push<string>(string(1,c));
+                continue;
+            }
+            size_t p = 0;
+            for(;;)
+            {
+                size_t e = s->find(sep, p);
+                if(e == string::npos)
+                {
+                    push<string>(s->substr(p));
+                    break;
+                }
+                push<string>(s->substr(p, e-p));
+                p = e + sep.size();
+            }
+        }
+    }
+    
+    // format, args... -> string ('%1% is %2%' or printf-style)
+    void fmt(){
+        auto st = move(m_Stream.top());
+        flush();
+        if(st.empty())
+            throw std::out_of_range("fmt requires a format string");
+        boost::format f(boost::any_cast<string>(st[0].val));
+        for(size_t i=1; i < st.size(); ++i)
+        {
+            switch(st[i].type)
+            {
+                case Variable::Int:
+                    f % boost::any_cast<int64_t>(st[i].val);
+                    break;
+                case Variable::Real:
+                    f % boost::any_cast<double>(st[i].val);
+                    break;
+                default:
+                    f % to_str(st[i]);
+                    break;
+            }
+        }
+        push<string>(f.str());
+    }
+    
+    // strings..., needle -> index of needle in each string (or -1)
+    void find(){
+        auto st = move(m_Stream.top());
+        flush();
+        string needle = pop_str(st);
+        for(auto&& v: st)
+        {
+            size_t p = as_str(v).find(needle);
+            push<int64_t>(p == string::npos ? -1 : (int64_t)p, Variable::Int);
+        }
+    }
+    
+    // strings..., from, to -> strings with all occurrences replaced
+    void replace(){
+        auto& st = m_Stream.top();
+        string to = pop_str(st);
+        string from = pop_str(st);
+        if(from.empty())
+            throw std::runtime_error("replace pattern is empty");
+        for(auto&& v: st)
+        {
+            string* s = boost::any_cast<string>(&v.val);
+            if(not s)
+                throw std::runtime_error("replace expects strings");
+            boost::replace_all(*s, from, to);
+        }
+    }
+    
+    // strings..., start[, len] -> substrings (in place)
+    void substr(){
+        auto& st = m_Stream.top();
+        vector<int64_t> idx;
+        while(not st.empty() && st.back().type == Variable::Int && idx.size() < 2)
+        {
+            idx.insert(idx.begin(), boost::any_cast<int64_t>(st.back().val));
+            st.pop_back();
+        }
+        if(idx.empty())
+            throw std::out_of_range("substr requires a start index");
+        for(auto&& v: st)
+        {
+            string* s = boost::any_cast<string>(&v.val);
+            if(not s)
+                throw std::runtime_error("substr expects strings");
+            int64_t b = idx[0] < 0 ? std::max<int64_t>(0, (int64_t)s->size() + idx[0]) : idx[0];
+            if((size_t)b >= s->size())
+            {
+                s->clear();
+                continue;
+            }
+            size_t n = idx.size() > 1 ? (size_t)std::max<int64_t>(0, idx[1]) : string::npos;
+            s->erase(0, b);
+            if(n < s->size())
+                s->resize(n);
+        }
+    }
+    
+    Tally tally()
+    {
+        auto& st = m_Stream.top();
+        // merging redoes the hashing, only worth it on several threads
+        if(st.size() < par_threshold || par_threads < 2)
+        {
+            Tally t;
+            for(auto&& v: st)
+                t.add(v);
+            return t;
+        }
+        // tally chunks apart, merged in order so first-seen order holds
+        vector<Tally> parts((st.size() + PAR_CHUNK - 1) / PAR_CHUNK);
+        parallel_chunks(st.size(), par_threads, [&](size_t c, size_t b, size_t e){
+            for(size_t i=b; i < e; ++i)
+                parts[c].add(st[i]);
+        });
+        Tally t = move(parts[0]);
+        for(size_t c=1; c < parts.size(); ++c)
+            t.merge(parts[c]);
+        return t;
+    }
+    
+    // values... -> distinct values, first-seen order
+    void uniq(){
+        Tally t = tally();
+        m_Stream.top() = move(t.values);
+    }
+    
+    // values... -> occurrences of each distinct value, in "uniq" order
+    void count(){
+        Tally t = tally();
+        flush();
+        for(size_t c: t.counts)
+            push<int64_t>((int64_t)c, Variable::Int);
+    }
+    
+    // values... -> value,count pairs
+    void histogram(){
+        Tally t = tally();
+        flush();
+        for(size_t i=0; i < t.values.size(); ++i)
+        {
+            m_Stream.top().push_back(move(t.values[i]));
+            push<int64_t>((int64_t)t.counts[i], Variable::Int);
+        }
+    }
+    
+    // values... -> same values with equal ones adjacent (stable)
+    void group(){
+        auto st = move(m_Stream.top());
+        flush();
+        unordered_map<string, size_t> index;
+        vector<vector<Variable>> groups;
+        for(auto&& v: st)
+        {
+            auto r = index.emplace(Tally::key(v), groups.size());
+            if(r.second)
+                groups.emplace_back();
+            groups[r.first->second].push_back(move(v));
+        }
+        for(auto&& g: groups)
+            std::move(ENTIRE(g), back_inserter(m_Stream.top()));
+    }
+    
+    void permute(const vector<size_t>& order)
+    {
+        auto st = move(m_Stream.top());
+        flush();
+        m_Stream.top().reserve(order.size());
+        for(size_t i: order)
+            m_Stream.top().push_back(move(st[i]));
+    }
+    
+    // values... -> ascending, stable
+    void sort(){
+        auto& st = m_Stream.top();
+        auto only = [&st](Variable::ID t){
+            return std::all_of(ENTIRE(st), [t](const Variable& v){
+                return v.type == t;
+            });
+        };
+        if(only(Variable::Int))
+        {
+            vector<int64_t> keys;
+            keys.reserve(st.size());
+            for(auto&& v: st)
+                keys.push_back(boost::any_cast<int64_t>(v.val));
+            permute(radix_order(keys));
+            return;
+        }
+        if(only(Variable::Real))
+        {
+            vector<int64_t> keys;
+            keys.reserve(st.size());
+            for(auto&& v: st)
+                keys.push_back(real_key(boost::any_cast<double>(v.val)));
+            permute(radix_order(keys));
+            return;
+        }
+        parallel_stable_sort(st.begin(), st.end(), less_than, par_threads);
+    }
+    
+    // values... -> ascending by numeric value (strings are parsed)
+    void sortn(){
+        auto& st = m_Stream.top();
+        vector<int64_t> keys;
+        keys.reserve(st.size());
+        
+        // ints past 2^53 don't survive a double, key them exactly
+        if(std::all_of(ENTIRE(st), [](const Variable& v){
+            return v.type == Variable::Int;
+        })){
+            for(auto&& v: st)
+                keys.push_back(boost::any_cast<int64_t>(v.val));
+            permute(radix_order(keys));
+            return;
+        }
+        for(auto&& v: st)
+        {
+            switch(v.type)
+            {
+                case Variable::Int:
+                case Variable::BigInt:
+                case Variable::Real:
+                    keys.push_back(real_key(to_real(v)));
+                    break;
+                case Variable::Bool:
+                    keys.push_back(real_key(boost::any_cast<bool>(v.val) ? 1.0 : 0.0));
+                    break;
+                default:
+                    keys.push_back(real_key(lexical_cast<double>(as_str(v))));
+                    break;
+            }
+        }
+        permute(radix_order(keys));
+    }
+    
+    // values..., k -> k largest values, descending
+    void topk(){
+        auto& st = m_Stream.top();
+        if(st.empty() || st.back().type != Variable::Int)
+            throw std::runtime_error("topk requires a count");
+        int64_t k = boost::any_cast<int64_t>(st.back().val);
+        st.pop_back();
+        if(k < 0)
+            throw std::out_of_range("topk count out of range");
+        
+        // heap selection over indices, earlier elements win ties
+        vector<size_t> order(st.size());
+        for(size_t i=0; i < order.size(); ++i)
+            order[i] = i;
+        size_t n = std::min<size_t>(k, order.size());
+        std::partial_sort(order.begin(), order.begin() + n, order.end(),
+            [&st](size_t a, size_t b){
+                if(less_than(st[b], st[a]))
+                    return true;
+                if(less_than(st[a], st[b]))
+                    return false;
+                return a < b;
+            }
+        );
+        order.resize(n);
+        permute(order);
+    }
+    
+    const Pattern& pattern(const string& s)
+    {
+        auto p = m_Patterns.find(s);
+        if(p != m_Patterns.end())
+            return p->second;
+        if(m_Patterns.size() >= PATTERN_CACHE)
+            m_Patterns.clear();
+        return m_Patterns.emplace(s, Pattern(s)).first->second;
+    }
+    
+    // strings..., pattern -> bool per string
+    void match(){
+        auto st = move(m_Stream.top());
+        flush();
+        const Pattern& p = pattern(pop_str(st));
+        for(auto&& v: st)
+            push<bool>(p.search(as_str(v)), Variable::Bool);
+    }
+    
+    // strings..., pattern -> strings that match
+    void grep(){
+        auto& st = m_Stream.top();
+        const Pattern& p = pattern(pop_str(st));
+        st.erase(std::remove_if(ENTIRE(st), [&p](const Variable& v){
+            const string* s = boost::any_cast<string>(&v.val);
+            return not s || not p.search(*s);
+        }), st.end());
+    }
+    
+    // strings..., pattern, replacement -> substituted strings
+    void sub(){
+        auto& st = m_Stream.top();
+        string fmt = pop_str(st);
+        const Pattern& p = pattern(pop_str(st));
+        for(auto&& v: st)
+        {
+            string* s = boost::any_cast<string>(&v.val);
+            if(not s)
+                throw std::runtime_error("sub expects strings");
+            // fmt is expanded ($&, $1, escapes) whatever the pattern,
+            // a plain one is copied in directly
+            if(p.literal && p.text.empty())
+                continue;
+            if(p.literal && fmt.find_first_of("$\\") == string::npos)
+                boost::replace_all(*s, p.text, fmt);
+            else
+                *s = boost::regex_replace(*s, p.re, fmt);
+        }
+    }
+    
+    // strings..., pattern -> groups of the first match in each string
+    void capture(){
+        auto st = move(m_Stream.top());
+        flush();
+        const Pattern& p = pattern(pop_str(st));
+        for(auto&& v: st)
+        {
+            const string& s = as_str(v);
+            if(p.literal)
+            {
+                if(s.find(p.text) != string::npos)
+                    push<string>(p.text);
+                continue;
+            }
+            boost::smatch m;
+            if(not boost::regex_search(s, m, p.re))
+                continue;
+            if(m.size() == 1)
+                push<string>(m.str(0));
+            for(size_t i=1; i < m.size(); ++i)
+                push<string>(m.str(i));
+        }
+    }
+    
+    void take(){
+        if(m_Stream.top().empty())
+            throw std::out_of_range("take requires a count");
+        auto st = move(m_Stream.top());
+        auto sz = st.spilled + st.size() - 1; // cut off count
+        flush();
+        // get count
+        int64_t b = boost::any_cast<int64_t>(st.back().val);
+        if(b<1)
+            throw std::out_of_range("slice length out of range");
+        
+        // list, n -> slice sharing the list's column
+        if(not st.spill && sz == 1 && st[0].type == Variable::List)
+        {
+            Slice l = boost::any_cast<Slice>(st[0].val);
+            l.size = std::min<int64_t>(b, l.size);
+            push<Slice>(move(l), Variable::List);
+            return;
+        }
+
+        // slice, reading a spilled front only as far as it goes
+        size_t n = std::min<int64_t>(b, sz);
+        size_t got = 0;
+        bool done = not n;
+        auto& out = m_Stream.top();
+        st.each_segment([&](vector<Variable>& vals){
+            for(auto&& v: vals)
+            {
+                out.push_back(move(v));
+                if(++got == n)
+                {
+                    done = true;
+                    break;
+                }
+                if(max_mem && not (got & 0xfff))
+                    budget(nullptr, true, true);
+            }
+        }, &done);
+    }
+    
+    void mark(){
+        if(not m_Block)
+            throw std::runtime_error("marks feature unavailable");
+        // resume at the line after the mark
+        m_Marks[
+            boost::any_cast<string>(m_Stream.top().at(0).val)
+        ] = { m_Block, m_PC + 1 };
+    }
+    void goto_mark()
+    {
+        string n = boost::any_cast<string>(m_Stream.top().at(0).val);
+        auto m = m_Marks.find(n);
+        if(m == m_Marks.end()){
+            throw std::runtime_error((boost::format(
+                "no such mark \'%s\'"
+                ) % n
+            ).str());
+        }
+        if(m->second.block != m_Block || m->second.pc > m_Block->size())
+            throw std::runtime_error((boost::format(
+                "mark \'%s\' is out of scope"
+                ) % n
+            ).str());
+        ++m_Stats.jumps;
+        m_Jump = m->second.pc;
+        m_Jumped = true;
+    }
+    
+    // decode a variable left in a restored snapshot,
+    // returns false if it was already in memory
+    bool resolve(const string& name)
+    {
+        auto l = m_Lazy.find(name);
+        if(l == m_Lazy.end())
+            return false;
+        l->second.file->map();
+        Reader r(l->second.file->data + l->second.offset, l->second.size);
+        Stream& var = m_Stack[name];
+        var.clear();
+        size_t n = r.get<uint64_t>();
+        for(size_t i=0; i < n; ++i)
+        {
+            var.push_back(r.value());
+            // a variable larger than the budget streams on to a spill
+            if(max_mem && not (var.size() & 0xfff) &&
+                resident() + var.size() * footprint(var.back()) > max_mem)
+                spill_front(var);
+        }
+        m_Lazy.erase(l);
+        ++m_Stats.reloads;
+        return true;
+    }
+    
+    // estimated bytes held in variables and the stream being built
+    size_t resident() const
+    {
+        auto& st = m_Stream.top();
+        size_t sz = m_VarBytes;
+        if(st.size() <= 64)
+            for(auto&& v: st)
+                sz += footprint(v);
+        else // spare capacity is held too
+            sz += st.size() * (footprint(st.back()) - sizeof(Variable)) +
+                st.capacity() * sizeof(Variable);
+        return sz;
+    }
+    
+    // note a use of a variable, remeasuring it if it changed
+    void touch(const string& name, bool changed)
+    {
+        Use& u = m_Use[name];
+        u.tick = ++m_Tick;
+        if(changed)
+        {
+            m_VarBytes -= u.bytes;
+            u.bytes = name.capacity();
+            for(auto&& v: m_Stack[name])
+                u.bytes += footprint(v);
+            m_VarBytes += u.bytes;
+        }
+        budget(&name, true);
+    }
+    
+    // called by builtins producing long streams, may spill their front
+    void grown()
+    {
+        if(max_mem && not (m_Stream.top().size() & 0xfff))
+            budget(nullptr, true);
+    }
+    
+    // spill the coldest variables until under max_mem, then if allowed
+    // the front of the top stream, and keep, the variable in use, last
+    // unless it is being walked (reading) and must stay where it is
+    // need is what's about to be loaded on top of what is resident
+    void budget(const string* keep = nullptr, bool stream = false,
+        bool reading = false, size_t need = 0)
+    {
+        if(not max_mem || resident() + need <= max_mem)
+            return;
+        vector<pair<uint64_t, string>> cold;
+        for(auto&& u: m_Use)
+            if(not keep || u.first != *keep)
+                cold.emplace_back(u.second.tick, u.first);
+        std::sort(ENTIRE(cold));
+        for(auto&& c: cold)
+        {
+            if(resident() + need <= max_mem)
+                break;
+            spill(c.second);
+        }
+        if(stream && resident() + need > max_mem)
+            spill_front(m_Stream.top());
+        if(keep && not reading && resident() + need > max_mem)
+            spill(*keep);
+        if(resident() + need > max_mem)
+            throw std::runtime_error((boost::format(
+                "memory budget of %s bytes exceeded"
+                ) % max_mem
+            ).str());
+    }
+    
+    // move all but the last value of a stream to its spill,
+    // as a new segment encoded as in snapshots
+    void spill_front(Stream& st)
+    {
+        if(st.size() < 2)
+            return;
+        for(auto&& v: st)
+            if(v.type == Variable::IO)
+                return;
+        // a spill shared with a stream that has grown since is continued
+        // in a new one, on top of the segments that are ours
+        if(not st.spill || st.segs != st.spill->segs.size())
+        {
+            auto sp = std::make_shared<Spill>();
+            sp->file = File::temp();
+            sp->base = st.spill;
+            sp->base_segs = st.segs;
+            st.spill = sp;
+            st.segs = 0;
+        }
+        Spill& sp = *st.spill;
+        
+        size_t n = st.size() - 1;
+        size_t start = sp.bytes;
+        string out;
+        for(size_t i=0; i < n; ++i)
+        {
+            encode(out, st[i]);
+            if(out.size() >= 1 << 20 || i + 1 == n)
+            {
+                write_all(sp.file->fd, out.data(), out.size());
+                sp.bytes += out.size();
+                out.clear();
+            }
+        }
+        st.spilled += n;
+        sp.segs.emplace_back(sp.bytes, n);
+        st.segs = sp.segs.size();
+        ++m_Stats.spills;
+        m_Stats.spilled_bytes += sp.bytes - start;
+        
+        // start over with a small buffer, the old one held everything
+        vector<Variable> rest;
+        rest.push_back(move(st.back()));
+        static_cast<vector<Variable>&>(st).swap(rest);
+    }
+    
+    // load the spilled front of a stream back into memory,
+    // callers check the budget once it is in place
+    void unspill(Stream& st)
+    {
+        if(not st.spill)
+            return;
+        // fail before allocating what wouldn't fit
+        budget(nullptr, false, true, st.spilled * footprint(st.back()));
+        vector<Variable> all;
+        all.reserve(st.spilled + st.size());
+        st.each_segment([&](vector<Variable>& vals){
+            std::move(ENTIRE(vals), back_inserter(all));
+        });
+        st = move(all);
+        ++m_Stats.reloads;
+    }
+    
+    // builtins that work through a spilled stream without loading it
+    bool streams(const string& name) const
+    {
+        return name == "len" || name == "+" || name == "*" ||
+            name == "out" || name == "dbg" || name == "take" ||
+            name == "front" || name == "back";
+    }
+    
+    // move all but the last value of a variable out to its spill
+    void spill(const string& name)
+    {
+        auto var = m_Stack.find(name);
+        size_t spills = m_Stats.spills;
+        spill_front(var->second);
+        if(m_Stats.spills == spills)
+            return;
+        Use& u = m_Use[name];
+        m_VarBytes -= u.bytes;
+        u.bytes = name.capacity() + footprint(var->second.back());
+        m_VarBytes += u.bytes;
+    }
+    
+    // path -> writes every variable to a snapshot file
+    // layout: magic, count, then per variable its name and encoded values
+    void snapshot()
+    {
+        auto st = move(m_Stream.top());
+        flush();
+        string path = pop_str(st);
+        
+        string out(SNAPSHOT_MAGIC, 4);
+        put<uint64_t>(out, m_Stack.size() + m_Lazy.size());
+        for(auto&& var: m_Stack)
+        {
+            put_str(out, var.first);
+            size_t at = out.size();
+            put<uint64_t>(out, 0);
+            size_t begin = out.size();
+            put<uint64_t>(out, var.second.spilled + var.second.size());
+            var.second.each_segment([&](vector<Variable>& vals){
+                for(auto&& v: vals)
+                    encode(out, v);
+            });
+            uint64_t len = out.size() - begin;
+            memcpy(&out[at], &len, sizeof(len));
+        }
+        // undecoded variables are copied through as they are
+        for(auto&& var: m_Lazy)
+        {
+            var.second.file->map();
+            put_str(out, var.first);
+            put<uint64_t>(out, var.second.size);
+            out.append(var.second.file->data + var.second.offset, var.second.size);
+        }
+        
+        // write aside and rename, so a failed write keeps the old snapshot
+        string tmp = path + ".tmp";
+        {
+            File f(tmp, O_WRONLY | O_CREAT | O_TRUNC);
+            write_all(f.fd, out.data(), out.size());
+        }
+        if(rename(tmp.c_str(), path.c_str()) != 0)
+            throw std::runtime_error("unable to write \'" + path + "\'");
+    }
+    
+    // path -> maps a snapshot, its variables are decoded when first used
+    void restore()
+    {
+        auto st = move(m_Stream.top());
+        flush();
+        string path = pop_str(st);
+        
+        auto f = std::make_shared<File>(path, O_RDONLY);
+        f->map();
+        Reader r(f->data, f->size);
+        if(f->size < 4 || memcmp(r.take(4), SNAPSHOT_MAGIC, 4) != 0)
+            throw std::runtime_error("\'" + path + "\' is not a snapshot");
+        size_t n = r.get<uint64_t>();
+        for(size_t i=0; i < n; ++i)
+        {
+            string name = r.get_str();
+            size_t len = r.get<uint64_t>();
+            size_t offset = r.take(len) - f->data;
+            m_Stack.erase(name);
+            auto u = m_Use.find(name);
+            if(u != m_Use.end())
+            {
+                m_VarBytes -= u->second.bytes;
+                m_Use.erase(u);
+            }
+            m_Lazy[name] = Lazy{f, offset, len};
+        }
+    }
+    
+    size_t stack_bytes() const
+    {
+        size_t sz = 0;
+        for(auto&& var: m_Stack)
+        {
+            sz += var.first.capacity();
+            for(auto&& v: var.second)
+                sz += footprint(v);
+        }
+        return sz;
+    }
+
+    Json::Value stats_json() const
+    {
+        Json::Value r;
+        r["tokens"] = (Json::UInt64)m_Stats.tokens;
+        r["allocs"] = (Json::UInt64)m_Stats.allocs;
+        r["stack_bytes"] = (Json::UInt64)stack_bytes();
+        r["peak_depth"] = (Json::UInt64)m_Stats.peak_depth;
+        r["jumps"] = (Json::UInt64)m_Stats.jumps;
+        r["spills"] = (Json::UInt64)m_Stats.spills;
+        r["spilled_bytes"] = (Json::UInt64)m_Stats.spilled_bytes;
+        r["reloads"] = (Json::UInt64)m_Stats.reloads;
+        if(max_mem)
+        {
+            r["max_mem"] = (Json::UInt64)max_mem;
+            r["resident_bytes"] = (Json::UInt64)resident();
+        }
+        r["blocked_ms"] = (Json::UInt64)std::chrono::duration_cast<
+            std::chrono::milliseconds
+        >(m_Stats.blocked).count();
+        Json::Value& calls = r["calls"] = Json::Value(Json::objectValue);
+        for(auto&& c: m_Stats.calls)
+            calls[c.first] = (Json::UInt64)c.second;
+        return r;
+    }
+
+    void stats()
+    {
+        Json::StreamWriterBuilder w;
+        w["indentation"] = "";
+        flush();
+        push<string>(Json::writeString(w, stats_json()));
+    }
+
+    Context() {
+        m_Funcs = {
+            {"out", std::bind(&Context::out_np,this)},
+            {"in", std::bind(&Context::in,this)},
+            {"dbg", std::bind(&Context::dbg,this)},
+            {"?", std::bind(&Context::q,this)},
+            {"not", std::bind(&Context::notop,this)},
+            {"assert", std::bind(&Context::assert_this,this)},
+            {"!", std::bind(&Context::notop,this)},
+            {"else", std::bind(&Context::noop,this)},
+            {"sleep", std::bind(&Context::sleep,this)},
+            {"len", std::bind(&Context::length,this)},
+            {"int", std::bind(&Context::cast_int,this)},
+            {"real", std::bind(&Context::cast_real,this)},
+            {"str", std::bind(&Context::cast_str,this)},
+            {"bool", std::bind(&Context::cast_bool,this)},
+            {"!!", std::bind(&Context::cast_bool,this)},
+            {"+", std::bind(&Context::sum,this)},
+            {"-", std::bind(&Context::diff,this)},
+            {"*", std::bind(&Context::mult,this)},
+            {"/", std::bind(&Context::div,this)},
+            {"_", std::bind(&Context::noop,this)},
+            {"flip", std::bind(&Context::flip,this)},
+            {"abs", std::bind(&Context::abs,this)},
+            {"rev", std::bind(&Context::rev,this)},
+            {"seq", std::bind(&Context::seq,this)},
+            {"<=", std::bind(&Context::lte,this)},
+            {">=", std::bind(&Context::gte,this)},
+            {"<", std::bind(&Context::lt,this)},
+            {">", std::bind(&Context::gt,this)},
+            {"==", std::bind(&Context::cmp,this)},
+            {"!=", std::bind(&Context::ncmp,this)},
+            {"rand", std::bind(&Context::randint,this)},
+            {"choice", std::bind(&Context::choice,this)},
+            {"shuffle", std::bind(&Context::shuffle,this)},
+            {"sample", std::bind(&Context::sample,this)},
+            {"type", std::bind(&Context::type,this)},
+            {"mark", std::bind(&Context::mark,this)},
+            {"jmp", std::bind(&Context::goto_mark,this)},
+            {"join", std::bind(&Context::join,this)},
+            {"concat", std::bind(&Context::concat,this)},
+            {"split", std::bind(&Context::split,this)},
+            {"fmt", std::bind(&Context::fmt,this)},
+            {"find", std::bind(&Context::find,this)},
+            {"replace", std::bind(&Context::replace,this)},
+            {"substr", std::bind(&Context::substr,this)},
+            {"uniq", std::bind(&Context::uniq,this)},
+            {"count", std::bind(&Context::count,this)},
+            {"histogram", std::bind(&Context::histogram,this)},
+            {"group", std::bind(&Context::group,this)},
+            {"sort", std::bind(&Context::sort,this)},
+            {"sortn", std::bind(&Context::sortn,this)},
+            {"topk", std::bind(&Context::topk,this)},
+            {"match", std::bind(&Context::match,this)},
+            {"grep", std::bind(&Context::grep,this)},
+            {"sub", std::bind(&Context::sub,this)},
+            {"capture", std::bind(&Context::capture,this)},
+            {"take", std::bind(&Context::take,this)},
+            {"list", std::bind(&Context::pack,this)},
+            {"open", std::bind(&Context::open,this)},
+            {"read", std::bind(&Context::read,this)},
+            {"lines", std::bind(&Context::lines,this)},
+            {"write", std::bind(&Context::write,this)},
+            {"spawn", std::bind(&Context::spawn,this)},
+            {"run", std::bind(&Context::run_cmd,this)},
+            {"status", std::bind(&Context::status,this)},
+            {"front", std::bind(&Context::front,this)},
+            {"back", std::bind(&Context::back,this)},
+            {"unpack", std::bind(&Context::unpack,this)},
+            {"stats", std::bind(&Context::stats,this)},
+            {"snapshot", std::bind(&Context::snapshot,this)},
+            {"restore", std::bind(&Context::restore,this)}
+        };
+        for(auto&& n: iox::natives())
+        {
+            if(m_Funcs.find(n.name) != m_Funcs.end())
+                throw std::runtime_error((boost::format(
+                    "cannot redefine builtin \'%s\'"
+                    ) % n.name
+                ).str());
+            iox::Native& native = m_Natives[n.name] = n;
+            m_Funcs[n.name] = std::bind(&Context::native, this, std::cref(native));
+        }
+    }
+    
+    // call a native builtin, each stream value is one argument
+    // lists and strings are passed in place, other values through
+    // a scratch copy; a lone argument may also be spread over the stream
+    // ints are widened where reals are expected
+    void native(const iox::Native& n)
+    {
+        static_assert((int)iox::Type::Str == Variable::String &&
+            (int)iox::Type::Real == Variable::Real &&
+            (int)iox::Type::Bool == Variable::Bool,
+            "native types must match Variable::ID"
+        );
+        auto& st = m_Stream.top();
+        auto elem = [](const Variable& v){
+            return v.type == Variable::List ?
+                boost::any_cast<Slice>(&v.val)->col->type : v.type;
+        };
+        auto accepts = [](iox::Type p, Variable::ID t){
+            return t == (Variable::ID)p ||
+                (p == iox::Type::Real && t == Variable::Int);
+        };
+        vector<iox::Arg> args;
+        Column scratch;
+        vector<vector<double>> widened;
+        bool fits = st.size() == n.params.size();
+        for(size_t i=0; fits && i < st.size(); ++i)
+            fits = accepts(n.params[i], elem(st[i]));
+        if(fits)
+        {
+            // scratch holds scalars, reserved so pointers into it stay put
+            scratch.ints.reserve(st.size());
+            scratch.reals.reserve(st.size());
+            scratch.bools.reserve(st.size());
+            for(size_t i=0; i < st.size(); ++i)
+            {
+                auto& v = st[i];
+                iox::Arg a;
+                a.size = 1;
+                a.type = n.params[i];
+                if(a.type == iox::Type::Real && elem(v) == Variable::Int)
+                {
+                    vector<double> w;
+                    if(v.type == Variable::List)
+                    {
+                        const Slice& l = *boost::any_cast<Slice>(&v.val);
+                        auto p = l.col->ints.begin() + l.offset;
+                        w.assign(p, p + l.size);
+                    }
+                    else
+                        w.push_back(boost::any_cast<int64_t>(v.val));
+                    a.size = w.size();
+                    a.data = w.data();
+                    widened.push_back(move(w));
+                    args.push_back(a);
+                    continue;
+                }
+                switch(v.type)
+                {
+                    case Variable::Int:
+                        scratch.ints.push_back(boost::any_cast<int64_t>(v.val));
+                        a.data = &scratch.ints.back();
+                        break;
+                    case Variable::Real:
+                        scratch.reals.push_back(boost::any_cast<double>(v.val));
+                        a.data = &scratch.reals.back();
+                        break;
+                    case Variable::Bool:
+                        scratch.bools.push_back(boost::any_cast<bool>(v.val));
+                        a.data = &scratch.bools.back();
+                        break;
+                    case Variable::String:
+                        a.data = boost::any_cast<string>(&v.val);
+                        break;
+                    default:
+                    {
+                        const Slice& l = *boost::any_cast<Slice>(&v.val);
+                        const Column& c = *l.col;
+                        a.size = l.size;
+                        switch(c.type)
+                        {
+                            case Variable::Int:
+                                a.data = c.ints.data() + l.offset;
+                                break;
+                            case Variable::Real:
+                                a.data = c.reals.data() + l.offset;
+                                break;
+                            case Variable::Bool:
+                                a.data = c.bools.data() + l.offset;
+                                break;
+                            default:
+                                a.data = c.strs.data() + l.offset;
+                                break;
+                        }
+                        break;
+                    }
+                }
+                args.push_back(a);
+            }
+        }
+        else if(n.params.size() == 1 && not st.empty())
+        {
+            // gather the stream into one argument, every value is
+            // checked first so a mismatch leaves the stream as it was
+            iox::Type p = n.params[0];
+            fits = true;
+            for(size_t i=0; fits && i < st.size(); ++i)
+                fits = st[i].type != Variable::List && accepts(p, st[i].type);
+            if(fits)
+            {
+                iox::Arg a;
+                a.type = p;
+                a.size = st.size();
+                switch(p)
+                {
+                    case iox::Type::Int:
+                        scratch.ints.reserve(st.size());
+                        for(auto&& v: st)
+                            scratch.ints.push_back(boost::any_cast<int64_t>(v.val));
+                        a.data = scratch.ints.data();
+                        break;
+                    case iox::Type::Real:
+                        scratch.reals.reserve(st.size());
+                        for(auto&& v: st)
+                            scratch.reals.push_back(v.type == Variable::Int ?
+                                (double)boost::any_cast<int64_t>(v.val) :
+                                boost::any_cast<double>(v.val));
+                        a.data = scratch.reals.data();
+                        break;
+                    case iox::Type::Bool:
+                        scratch.bools.reserve(st.size());
+                        for(auto&& v: st)
+                            scratch.bools.push_back(boost::any_cast<bool>(v.val));
+                        a.data = scratch.bools.data();
+                        break;
+                    default:
+                        // copied, the stream is left whole if fn throws
+                        scratch.strs.reserve(st.size());
+                        for(auto&& v: st)
+                            scratch.strs.push_back(as_str(v));
+                        a.data = scratch.strs.data();
+                        break;
+                }
+                args.push_back(a);
+            }
+        }
+        if(not fits)
+        {
+            string sig;
+            for(auto&& t: n.params)
+                sig += (sig.empty() ? "" : ", ") + type_names()[(int)t];
+            throw std::runtime_error((boost::format(
+                "\'%s\' takes (%s)"
+                ) % n.name % sig
+            ).str());
+        }
+        
+        iox::Result r;
+        size_t sz = args.size() == 1 ? args[0].size : 0;
+        if(n.elementwise && n.parallel && sz >= par_threshold)
+        {
+            vector<iox::Result> parts((sz + PAR_CHUNK - 1) / PAR_CHUNK);
+            size_t width = args[0].type == iox::Type::Int ? sizeof(int64_t) :
+                args[0].type == iox::Type::Real ? sizeof(double) :
+                args[0].type == iox::Type::Bool ? sizeof(char) :
+                sizeof(string);
+            parallel_chunks(sz, par_threads, [&](size_t c, size_t b, size_t e){
+                vector<iox::Arg> chunk(1, args[0]);
+                chunk[0].data = (const char*)args[0].data + b * width;
+                chunk[0].size = e - b;
+                n.fn(chunk, parts[c]);
+            });
+            for(auto&& p: parts)
+            {
+                std::move(ENTIRE(p.ints), back_inserter(r.ints));
+                std::move(ENTIRE(p.reals), back_inserter(r.reals));
+                std::move(ENTIRE(p.strs), back_inserter(r.strs));
+                std::move(ENTIRE(p.bools), back_inserter(r.bools));
+            }
+        }
+        else
+            n.fn(args, r);
+        
+        size_t stray =
+            (n.result == iox::Type::Int ? 0 : r.ints.size()) +
+            (n.result == iox::Type::Real ? 0 : r.reals.size()) +
+            (n.result == iox::Type::Str ? 0 : r.strs.size()) +
+            (n.result == iox::Type::Bool ? 0 : r.bools.size());
+        if(stray)
+            throw std::runtime_error((boost::format(
+                "\'%s\' returned values that are not %s"
+                ) % n.name % type_names()[(int)n.result]
+            ).str());
+        
+        flush();
+        auto col = std::make_shared<Column>();
+        col->type = (Variable::ID)n.result;
+        col->ints = move(r.ints);
+        col->reals = move(r.reals);
+        col->strs = move(r.strs);
+        col->bools = move(r.bools);
+        Slice l;
+        l.col = col;
+        l.size = col->type == Variable::Int ? col->ints.size() :
+            col->type == Variable::Real ? col->reals.size() :
+            col->type == Variable::Bool ? col->bools.size() :
+            col->strs.size();
+        if(l.size == 1)
+            m_Stream.top().push_back(l.at(0));
+        else if(l.size)
+            push<Slice>(move(l), Variable::List);
+    }
+    
+    // a token that pushes the same value every time it runs
+    static bool literal(const string& s)
+    {
+        if(s.empty() || s == "_")
+            return false;
+        if(s[0] == '\'' || s[0] == '\"' || s == "true" || s == "false")
+            return true;
+        try{
+            lexical_cast<double>(s);
+            return true;
+        }catch(const boost::bad_lexical_cast&){
+            return false;
+        }
+    }
+    
+    // run pure natives fed only by literals now, leaving their result
+    void fold(Line& l)
+    {
+        auto& t = l.tokens;
+        for(size_t j=1; j < t.size(); ++j)
+        {
+            auto n = m_Natives.find(t[j].text);
+            if(n == m_Natives.end() || not n->second.pure)
+                continue;
+            // literals before it, chained by commas, starting a new pipe
+            auto lit = [&](size_t i){
+                string s = t[i].text;
+                if(s.back() == ',')
+                    s.pop_back();
+                return literal(s);
+            };
+            if(t[j-1].text.back() == ',' || not lit(j-1))
+                continue;
+            size_t k = j-1;
+            while(k && t[k-1].text.back() == ',' && lit(k-1))
+                --k;
+            if(k && t[k-1].text.back() == ',')
+                continue;
+            
+            push_stream();
+            auto cycled = m_Cycled;
+            try{
+                for(size_t i=k; i <= j; ++i)
+                    token(t[i].text);
+            }catch(const std::exception&){
+                // leave it for the line to raise when it runs
+                pop_stream();
+                m_Cycled = move(cycled);
+                continue;
+            }
+            Token f(t[j].text);
+            f.folded = std::make_shared<vector<Variable>>(move(m_Stream.top()));
+            pop_stream();
+            m_Cycled = move(cycled);
+            t.erase(t.begin() + k, t.begin() + j);
+            t[k] = move(f);
+            j = k;
+        }
+    }
+    
+    void define(const std::string& name, vector<Line> body)
+    {
+        if(m_Funcs.find(name) != m_Funcs.end())
+            throw std::runtime_error((boost::format(
+                "cannot redefine builtin \'%s\'"
+                ) % name
+            ).str());
+        // assign in place so cached call sites stay valid
+        UserFunction& f = m_Users[name];
+        f.name = name;
+        f.body = move(body);
+    }
+    
+    // tokenize source lines, defining the functions declared in them
+    vector<Line> compile(const vector<string>& src, unsigned first_ln = 0)
+    {
+        vector<Line> lines;
+        Line l;
+        for(size_t i=0; i < src.size(); ++i)
+        {
+            if(not tokenize(src[i], first_ln + i, l))
+                continue;
+            if(not m_Natives.empty())
+                fold(l);
+            lines.push_back(move(l));
+        }
+        
+        vector<Line> r;
+        for(size_t i=0; i < lines.size(); ++i)
+        {
+            string name = declaration(lines[i]);
+            if(name.empty())
+            {
+                r.push_back(move(lines[i]));
+                continue;
+            }
+            
+            // body is the rest of the line, or the indented block after it
+            vector<Line> body;
+            Line& d = lines[i];
+            if(d.tokens.size() > 1)
+            {
+                Line b;
+                b.ln = d.ln;
+                b.indent = d.indent + 1;
+                b.quiet = d.quiet;
+                b.tokens.assign(d.tokens.begin() + 1, d.tokens.end());
+                body.push_back(move(b));
+            }
+            size_t j = i + 1;
+            for(; j < lines.size() && lines[j].indent > d.indent; ++j)
+                body.push_back(move(lines[j]));
+            link(body);
+            define(name, move(body));
+            i = j - 1;
+        }
+        link(r);
+        return r;
+    }
+    
+    // run the tokens of a line, returns false if a condition failed
+    bool line(Line& l, size_t sz = std::numeric_limits<size_t>::max())
+    {
+        Traced trace('l', "line", l.ln);
+        ln = l.ln;
+        sz = std::min(sz, l.tokens.size());
+        for(size_t i=0; i < sz; ++i)
+        {
+            tok = i;
+            Token& t = l.tokens[i];
+            if(i == 0) // first token on line
+            {
+                if(t.text == "_")
+                    recycle();
+                else
+                    cycle();
+            }
+            if(not token(t))
+                return false; // short circuit
+        }
+        return true;
+    }
+    
+    // run a linked block, returns true if the last line run was quiet
+    bool run(vector<Line>& lines)
+    {
+        // a jmp earlier on the calling line is still pending after us
+        auto block = m_Block;
+        auto pc = m_PC;
+        auto jump = m_Jump;
+        auto jumped = m_Jumped;
+        BOOST_SCOPE_EXIT_ALL(&) {
+            m_Block = block;
+            m_PC = pc;
+            m_Jump = jump;
+            m_Jumped = jumped;
+        };
+        m_Block = &lines;
+        m_Jumped = false;
+        return run(0, lines.size());
+    }
+    
+    // run lines [b,e) of the current block
+    // a jmp out of the range is left pending for the enclosing range
+    bool run(size_t b, size_t e)
+    {
+        auto& lines = *m_Block;
+        bool quiet = false;
+        bool enter = false; // jumped into an else block
+        for(m_PC = b; m_PC < e;)
+        {
+            Line& l = lines[m_PC];
+            if(l.otherwise && not enter)
+            {
+                // fell through from a taken branch
+                m_PC = l.end;
+                continue;
+            }
+            enter = false;
+            m_Jumped = false;
+            quiet = l.quiet;
+            if(l.loop)
+                loop(l);
+            else if(line(l))
+                ++m_PC;
+            else
+            {
+                m_PC = l.end;
+                enter = m_PC < e &&
+                    lines[m_PC].otherwise &&
+                    lines[m_PC].indent == l.indent;
+            }
+            if(m_Jumped)
+            {
+                if(m_Jump < b || m_Jump >= e)
+                    break;
+                m_Jumped = false;
+                m_PC = m_Jump;
+            }
+        }
+        return quiet;
+    }
+    
+    // run a loop line and its body in place, leaves m_PC past the body
+    void loop(Line& l)
+    {
+        size_t pc = m_PC;
+        size_t body = pc + 1;
+        size_t n = l.tokens.size() - 1; // skip loop keyword
+        BOOST_SCOPE_EXIT_ALL(&) {
+            m_PC = l.end;
+        };
+        
+        if(l.loop == Line::While)
+        {
+            // line before "while" is the condition, rerun each iteration
+            auto depth = m_Stream.size();
+            for(;;)
+            {
+                m_PC = pc;
+                if(not line(l, n))
+                    break;
+                unspill(m_Stream.top());
+                budget();
+                q();
+                if(not cond)
+                    break;
+                run(body, l.end);
+                while(m_Stream.size() > depth)
+                    m_Stream.pop();
+                if(m_Jumped)
+                    return;
+            }
+            return;
+        }
+        
+        // each: run the body once per element, collecting the results
+        // a spilled stream is walked a segment at a time, and results
+        // past the budget are spilled in turn
+        if(not line(l, n))
+            return;
+        auto items = move(m_Stream.top());
+        auto depth = m_Stream.size();
+        Stream results;
+        size_t got = 0;
+        bool done = false;
+        items.each_segment([&](vector<Variable>& vals){
+            for(auto&& v: vals)
+            {
+                m_Stream.top().clear();
+                m_Stream.top().push_back(move(v));
+                m_Cycled = m_Stream.top();
+                run(body, l.end);
+                if(not m_Jumped)
+                    std::move(ENTIRE(m_Stream.top()), back_inserter(results));
+                while(m_Stream.size() > depth)
+                    m_Stream.pop();
+                if(m_Jumped)
+                {
+                    done = true;
+                    return;
+                }
+                if(max_mem && not (++got & 0xfff) && not results.empty() &&
+                    resident() + results.size() * footprint(results.back()) > max_mem)
+                    spill_front(results);
+            }
+        }, &done);
+        if(done)
+            return;
+        m_Stream.top() = move(results);
+    }
+    
+    // run a user function in its own frame
+    // the stream is its input (_), the last line's stream its output,
+    // variables it sets are its own and gone when it returns
+    void call(UserFunction& fn)
+    {
+        Traced trace('c', fn.name.c_str());
+        auto depth = m_Stream.size();
+        auto cycled = move(m_Cycled);
+        m_Cycled = m_Stream.top();
+        auto input = move(m_Stream.top());
+        push_stream();
+        m_Stream.top() = move(input);
+        BOOST_SCOPE_EXIT_ALL(&) {
+            auto ret = move(m_Stream.top());
+            while(m_Stream.size() > depth)
+                m_Stream.pop();
+            m_Stream.top() = move(ret);
+            m_Cycled = move(cycled);
+        };
+        
+        m_Frames.emplace_back();
+        BOOST_SCOPE_EXIT_ALL(&) {
+            m_Frames.pop_back();
+        };
+        
+        if(run(fn.body))
+            m_Stream.top().clear();
+    }
+    
+    bool token(Token& t)
+    {
+        if(t.folded)
+        {
+            ++m_Stats.tokens;
+            if(not append)
+                cycle();
+            append = false;
+            copy(ENTIRE(*t.folded), back_inserter(m_Stream.top()));
+            return true;
+        }
+        // cached call site, skip parsing and lookup
+        if(t.builtin)
+        {
+            ++m_Stats.tokens;
+            ++*t.calls;
+            append = false;
+            cond = true;
+            Traced trace('b', t.text.c_str());
+            if(m_Stream.top().spill && not streams(t.text))
+            {
+                unspill(m_Stream.top());
+                budget();
+            }
+            (*t.builtin)();
+            return cond;
+        }
+        if(t.user)
+        {
+            ++m_Stats.tokens;
+            ++*t.calls;
+            append = false;
+            call(*t.user);
+            return true;
+        }
+        return token(t.text, &t);
+    }
+    
+    bool token(std::string s, Token* cache = nullptr)
+    {
+        if(s.empty())
+            return true;
+        ++m_Stats.tokens;
+        auto len = s.length();
+        
+        bool append_this = append;
+        
+        if(s[len-1]==',')
+        {
+            append = true;
+            s = s.substr(0, --len); // cut comma
+        }
+        else
+        {
+            append = false;
+        }
+        
+        // string
+        if(s[0] == '\"' || s[0] == '\'')
+        {
+            s = s.substr(1, len -= 2); // cut quotes
+            if(not append_this)
+                cycle();
+            push<string>(s);
+            return true;
+        }
+
+        if(s=="_")
+        {
+            if(not append_this)
+                cycle();
+            // a spilled stream is read through, spilling the front of
+            // this one again as it grows
+            auto& st = m_Stream.top();
+            size_t got = 0;
+            m_Cycled.each_segment([&](vector<Variable>& vals){
+                for(auto&& v: vals)
+                {
+                    st.push_back(v);
+                    if(max_mem && not (++got & 0xfff))
+                        budget(nullptr, true, true);
+                }
+            });
+            return true;
+        }
+        
+        if(s=="false")
+        {
+            if(not append_this)
+                cycle();
+            push<bool>(false, Variable::Bool);
+            return true;
+        }
+        else if(s=="true")
+        {
+            if(not append_this)
+                cycle();
+            push<bool>(true, Variable::Bool);
+            return true;
+        }
+
+        // var
+        if(s[0]=='$')
+        {
+            // put var in stream
+            s = s.substr(1);
+            bool changed = not m_Lazy.empty() && resolve(s);
+            
+            // inside a function, the call's own variables come first
+            // and are where it sets them; globals are still read
+            Stream* local = nullptr;
+            if(not m_Frames.empty())
+            {
+                auto l = m_Frames.back().find(s);
+                if(l != m_Frames.back().end())
+                    local = &l->second;
+            }
+
+            // set
+            if(not m_Stream.top().empty())
+            {
+                if(not append_this)
+                {
+                    if(not m_Frames.empty())
+                    {
+                        m_Frames.back()[s] = m_Stream.top();
+                        return true;
+                    }
+                    m_Stack[s] = m_Stream.top();
+                    changed = true;
+                }
+                else
+                {
+                    // a spilled variable is read through, spilling
+                    // the stream's front again as it grows, but never
+                    // the variable itself while its values are walked
+                    Stream& var = local ? *local : m_Stack[s];
+                    auto& st = m_Stream.top();
+                    var.each_segment([&](vector<Variable>& vals){
+                        for(auto&& v: vals)
+                        {
+                            st.push_back(v);
+                            if(max_mem && not (st.size() & 0xfff))
+                                budget(&s, true, true);
+                        }
+                    });
+                }
+            }
+            else // stream empty?
+            {
+                // get
+                try{
+                    flush();
+                    // shares a spilled front rather than loading it
+                    m_Stream.top() = local ? *local : m_Stack.at(s);
+                }catch(const std::exception& e){
+                    throw std::runtime_error((boost::format(
+                        "no such variable \'%s\'"
+                        ) % s
+                    ).str());
+                }
+            }
+            // only globals are held to the budget
+            if(max_mem && not local)
+                touch(s, changed);
+            return true;
+        }
+        
+        if(try_push<int64_t>(s, Variable::Int, append_this))
+            return true;
+
+        // integer literal too wide for int64_t
+        if(s.find_first_not_of("0123456789", s[0] == '-') == string::npos &&
+            s.size() > 1)
+        {
+            if(not append_this)
+                cycle();
+            ++m_Stats.allocs;
+            m_Stream.top().push_back(make_int(big_int(s)));
+            return true;
+        }
+
+        if(try_push<double>(s, Variable::Real, append_this))
+            return true;
+        
+        auto func = m_Funcs.find(s);
+        if(func != m_Funcs.end())
+        {
+            auto& calls = m_Stats.calls[func->first];
+            ++calls;
+            if(cache && not append)
+            {
+                cache->builtin = &func->second;
+                cache->calls = &calls;
+            }
+            cond = true;
+            Traced trace('b', func->first.c_str());
+            if(m_Stream.top().spill && not streams(func->first))
+            {
+                unspill(m_Stream.top());
+                budget();
+            }
+            func->second();
+            return cond;
+        }
+        
+        auto user = m_Users.find(s);
+        if(user != m_Users.end())
+        {
+            auto& calls = m_Stats.calls[user->first];
+            ++calls;
+            if(cache && not append)
+            {
+                cache->user = &user->second;
+                cache->calls = &calls;
+            }
+            call(user->second);
+        }
+        else
+        {
+            throw std::runtime_error((boost::format(
+                "no such function \'%s\'"
+                ) % s
+            ).str());
+        }
+        
+        return true;
+    }
+};
+
+#endif
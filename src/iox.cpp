@@ -0,0 +1,124 @@
+#include "iox.h"
+#include "context.h"
+
+namespace iox
+{
+    // an interpreter with the script already compiled into it
+    // token caches point into its own tables, so it is never shared
+    struct Instance
+    {
+        Context ctx;
+        vector<Line> program;
+    };
+
+    struct Script::Impl
+    {
+        vector<string> src;
+        std::mutex mtx;
+        vector<std::unique_ptr<Instance>> idle;
+
+        std::unique_ptr<Instance> make()
+        {
+            std::unique_ptr<Instance> r(new Instance);
+            r->program = r->ctx.compile(src);
+            return r;
+        }
+
+        std::unique_ptr<Instance> acquire()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if(not idle.empty())
+                {
+                    auto r = move(idle.back());
+                    idle.pop_back();
+                    return r;
+                }
+            }
+            return make();
+        }
+
+        void release(std::unique_ptr<Instance> inst)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            idle.push_back(move(inst));
+        }
+    };
+
+    Script::Script(const vector<string>& src):
+        m(new Impl)
+    {
+        m->src = src;
+        // compile once up front so errors surface here, not on a run
+        m->idle.push_back(m->make());
+    }
+
+    Script Script::load(const string& path)
+    {
+        ifstream file(path);
+        if(not file.is_open())
+            throw std::runtime_error((boost::format(
+                "unable to open \'%s\'"
+                ) % path
+            ).str());
+        vector<string> src;
+        string line;
+        while(std::getline(file, line))
+            src.push_back(move(line));
+        return Script(src);
+    }
+
+    Script::Script(Script&&) = default;
+    Script& Script::operator=(Script&&) = default;
+    Script::~Script() = default;
+
+    vector<string> Script::run(const vector<string>& input, std::ostream* out)
+    {
+        auto inst = m->acquire();
+        Context& ctx = inst->ctx;
+        BOOST_SCOPE_EXIT_ALL(&) {
+            ctx.m_Out = &std::cout;
+            m->release(move(inst));
+        };
+
+        // leave nothing from the last run behind
+        ctx.clear();
+        ctx.m_Marks.clear();
+        ctx.m_Cycled.clear();
+        ctx.append = false;
+        ctx.cond = true;
+        ctx.m_Out = out ? out : &std::cout;
+
+        auto& st = ctx.m_Stream.top();
+        st.reserve(input.size());
+        for(auto&& s: input)
+            st.emplace_back(s, Variable::String);
+        ctx.m_Cycled = st;
+
+        ctx.run(inst->program);
+        ctx.unspill(ctx.m_Stream.top());
+        ctx.budget();
+
+        vector<string> r;
+        for(auto&& v: ctx.m_Stream.top())
+            r.push_back(to_str(v));
+        return r;
+    }
+
+    void Script::reserve(size_t n)
+    {
+        vector<std::unique_ptr<Instance>> made;
+        {
+            std::lock_guard<std::mutex> lock(m->mtx);
+            if(m->idle.size() >= n)
+                return;
+            n -= m->idle.size();
+        }
+        for(size_t i=0; i < n; ++i)
+            made.push_back(m->make());
+        std::lock_guard<std::mutex> lock(m->mtx);
+        for(auto&& inst: made)
+            m->idle.push_back(move(inst));
+    }
+}
+
@@ -0,0 +1,47 @@
+#ifndef _IOX_H
+#define _IOX_H
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace iox
+{
+    // A compiled script that host code can run many times, from any thread.
+    //
+    // Each run borrows an interpreter from a pool kept by the script.
+    // Pooled interpreters have their builtins set up and the script
+    // compiled already, so a run only resets their streams and variables.
+    class Script
+    {
+        public:
+
+            // compiles the source, throws std::runtime_error on bad input
+            explicit Script(const std::vector<std::string>& src);
+            static Script load(const std::string& path);
+
+            Script(Script&&);
+            Script& operator=(Script&&);
+            ~Script();
+
+            // input is the stream (_) the first line starts with,
+            // returns the stream left after the last line
+            // out and dbg write to out, or stdout if it is null
+            std::vector<std::string> run(
+                const std::vector<std::string>& input = {},
+                std::ostream* out = nullptr
+            );
+
+            // pre-initialise interpreters for n concurrent runs
+            void reserve(size_t n);
+
+        private:
+
+            struct Impl;
+            std::unique_ptr<Impl> m;
+    };
+}
+
+#endif
+
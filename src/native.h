@@ -0,0 +1,128 @@
+#ifndef _NATIVE_H
+#define _NATIVE_H
+
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <dlfcn.h>
+
+// plugins are shared libraries defining IOX_PLUGIN, which appends
+// their builtins, and must be built against this header
+#define IOX_PLUGIN \
+    extern "C" void iox_plugin(std::vector<iox::Native>& natives)
+
+namespace iox
+{
+    // value types a native builtin can take or return
+    // numbered like the interpreter's own Variable::ID
+    enum class Type
+    {
+        Int = 0,
+        Str,
+        Real,
+        Bool
+    };
+
+    // a read-only run of values, pointing straight into interpreter storage
+    template<class T>
+    struct Span
+    {
+        const T* data = nullptr;
+        size_t size = 0;
+
+        const T* begin() const { return data; }
+        const T* end() const { return data + size; }
+        const T& operator[](size_t i) const { return data[i]; }
+        bool empty() const { return size == 0; }
+    };
+
+    // one argument: a list passes its whole column, a single value one item
+    // bools are stored one per char
+    struct Arg
+    {
+        Type type;
+        const void* data;
+        size_t size;
+
+        template<class T>
+        Span<T> as() const
+        {
+            Span<T> s;
+            s.data = static_cast<const T*>(data);
+            s.size = size;
+            return s;
+        }
+    };
+
+    // output of a native builtin, fill the vector of the declared type
+    // one value is pushed to the stream as is, more as a list
+    struct Result
+    {
+        std::vector<int64_t> ints;
+        std::vector<double> reals;
+        std::vector<std::string> strs;
+        std::vector<char> bools;
+    };
+
+    struct Native
+    {
+        std::string name;
+        std::vector<Type> params;
+        Type result = Type::Int;
+
+        // same arguments always give the same result and nothing else
+        // happens, so calls on literals are folded when a script compiles
+        bool pure = false;
+
+        // result i depends only on item i of a single argument,
+        // so long arguments may be split into chunks
+        bool elementwise = false;
+
+        // fn may run on several chunks at once from different threads
+        bool parallel = false;
+
+        std::function<void(const std::vector<Arg>&, Result&)> fn;
+    };
+
+    // builtins picked up by every interpreter created after they are added
+    // not synchronised, register before running scripts
+    inline std::vector<Native>& natives()
+    {
+        static std::vector<Native> r;
+        return r;
+    }
+
+    // names must be unique, clashes with the interpreter's own
+    // builtins are reported when an interpreter is created
+    inline void add_builtin(Native n)
+    {
+        for(auto&& r: natives())
+            if(r.name == n.name)
+                throw std::runtime_error(
+                    "builtin \'" + n.name + "\' is already registered"
+                );
+        natives().push_back(std::move(n));
+    }
+
+    inline void load_plugin(const std::string& path)
+    {
+        // never closed, its builtins live as long as the process
+        void* lib = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if(not lib)
+            throw std::runtime_error(dlerror());
+        auto entry = (void(*)(std::vector<Native>&))dlsym(lib, "iox_plugin");
+        if(not entry)
+            throw std::runtime_error(
+                "\'" + path + "\' is not an iox plugin"
+            );
+        std::vector<Native> added;
+        entry(added);
+        for(auto&& n: added)
+            add_builtin(std::move(n));
+    }
+}
+
+#endif
+